@@ -2,300 +2,3715 @@
  * This program counts the number e to the nearest N. N is specified by
  *    the first argument of the program. It is mandatory. In the result
  *    this programs creates file ret_e.txt this first N digits of e.
- *    Second arument of program is optinal. If this one is "apr" the
- *    program will use aproximation (digits = 3*N + 1) else digits count
- *    will be calulated before the program start.
+ *    Second arument of program is the way to find count of terms. If this
+ *    one is "step" the count is found by division of 1 by 2, 3, ... until
+ *    it is zero, else (e.g. "apr") the same count is estimated by lgamma.
+ * Next arguments are options:
+ *    --const <e|pi|ln2|sqrt:n|exp:u/v> - the constant, e by default. The
+ *        other ones are sums of the same engine with their own series and
+ *        are written into output/ret_<pi|ln2|sqrt|exp>.txt, they work
+ *        only with "div" and "dec".
+ *        exp:u/v is exp of the non-negative rational u/v with u <= 64,
+ *        v > 0 and u/v <= 16, negative x isn't supported.
+ *    --alg <div|bs> - algorithm of the summation. "div" (default) divides
+ *        full-precision number by every k, "bs" uses binary splitting
+ *        on integers and makes the only division on the rank 0.
+ *    --reduce <chain|tree|pipe> - how partial sums are gathered on the
+ *        rank 0. "chain" (default) passes the sum from the last rank down
+ *        rank by rank, "tree" merges pairs of ranks in log2(size) steps,
+ *        "pipe" is the chain with the sum passed in chunks, so that the
+ *        ranks multiply at the same time. "bs" takes "pipe" as "chain".
+ *    --radix <dec|bin> - limbs of the numbers in the "div" algorithm.
+ *        "dec" (default) is base 10^9, "bin" is base 2^64, the digits
+ *        are converted to decimal only for the output.
+ *    --threads <T> - count of threads on every rank for the "div"
+ *        algorithm. The range of the rank is split between threads with
+ *        their own partial sums, which are merged before MPI stage.
+ *    --checkpoint <seconds> - save the state of the summation every given
+ *        seconds into output/checkpoint_<series>_<rank>_<thread>.bin.
+ *        Like --threads it is only for the "div" algorithm.
+ *    --resume - continue the summation from the checkpoint files. The run
+ *        must have the same digits, ranks and threads.
+ *    --verify - compare the written digits with data/e_ref.txt, report
+ *        the first mismatching digit and fail on a mismatch. sqrt of a
+ *        perfect square, e.g. sqrt:1 or sqrt:4, is compared with its
+ *        exact root.
+ *    --bench <mul|div|add|n|series|scale> - run the benchmark on the
+ *        rank 0 instead of the computation. "mul" compares multiplication
+ *        tiers, "div" compares hardware and reciprocal division by a small
+ *        divisor, "add" compares the scalar and the vector additions of
+ *        the CPU, "n" checks the lgamma count of terms against the
+ *        stepping one.
+ *        "series" times every constant on all ranks at 10^4, 10^5 and 10^6
+ *        digits, but not more than the first argument.
+ *        "scale" sums e on 1, 2, 4, ... ranks up to all of them, with the
+ *        strong (the first argument, a tenth and a hundredth of it) and
+ *        the weak (the first argument times the share of ranks) digits.
+ *        Every row has the wall times of the count of terms, the local
+ *        sum, the reduction and the output in output/ret_scale.txt.
+ *        It runs only the "div" algorithm.
+ *    --format <csv|json> - rows of "scale", csv by default.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
 #include "mpi.h"
 #include "../slibs/err_proc.h"
 
 
 
 constexpr int UPPER_SUM_TAG = 1;
+constexpr int BS_P_TAG = 2;
+constexpr int BS_Q_TAG = 3;
+constexpr int UPPER_DEVISIBLE_TAG = 4;
 
-class Decimal {
-    static_assert(sizeof(uint32_t) == 4);
-    static_assert(sizeof(uint64_t) == 8);
+enum Reduction {
+    RED_CHAIN,
+    RED_TREE,
+    RED_PIPE,
+};
 
-    static constexpr uint32_t base = 1'000'000'000;
-    static constexpr uint32_t base_len = 9;
+// Ranks of the computation, --bench scale narrows it to the first ranks
+MPI_Comm calc_comm = MPI_COMM_WORLD;
 
-    std::size_t size = 0;
-    uint32_t *arr = nullptr;
+// ------------------------------------------------------------------ memory
+
+/*
+ * Scratch memory of the multiplication kernels. It is taken in the stack
+ *    order through ScratchScope and stays in the arena after the release,
+ *    so after the first product of a size the kernels don't use the heap.
+ *    Every thread has its own arena, see scratch_arena.
+ */
+class ScratchArena {
+    static constexpr std::size_t align = 64;
+    static constexpr std::size_t min_block = 1 << 16;
+
+    struct Block {
+        char* data;
+        std::size_t size;
+    };
+
+    std::vector<Block> blocks;
+    std::size_t block = 0;
+    std::size_t offset = 0;
 
     public:
-        Decimal(uint32_t a, std::size_t digits)
-            : size(digits)
-            , arr(new uint32_t[size])
-        {
-            for (int q = 0; q < size; ++q) {
-                arr[q] = 0;
+        struct Mark {
+            std::size_t block;
+            std::size_t offset;
+        };
+
+        ScratchArena() = default;
+        ScratchArena(const ScratchArena&) = delete;
+        void operator=(const ScratchArena&) = delete;
+
+        ~ScratchArena() {
+            for (Block& b : blocks) {
+                delete [] b.data;
             }
-            arr[0] = a;
         }
 
-        static int dti(char digit) {
-            return digit - '0';
+        void* alloc(std::size_t bytes) {
+            bytes = (bytes + align - 1) / align * align;
+            while (block < blocks.size()
+                            && offset + bytes > blocks[block].size) {
+                ++block;
+                offset = 0;
+            }
+            if (block == blocks.size()) {
+                std::size_t size = std::max(bytes, min_block);
+                if (!blocks.empty()) {
+                    size = std::max(size, 2 * blocks.back().size);
+                }
+                blocks.push_back(Block{new char[size], size});
+                offset = 0;
+            }
+            void* ret = blocks[block].data + offset;
+            offset += bytes;
+            return ret;
         }
 
-        Decimal(const char* str) {
-            std::size_t len = std::strlen(str);
-
-            int comma_pos = 0;
-            uint32_t ved = 0;
-            while (str[++comma_pos] != '.') {}
-            uint32_t mult = 1;
-            for (int q = comma_pos; q > 0; --q) {
-                ved += dti(str[q-1]) * mult;
-                mult *= 10;
+        // Makes the first block at least bytes long, the arena must be free
+        void reserve(std::size_t bytes) {
+            assert(block == 0 && offset == 0);
+            if (!blocks.empty() && blocks[0].size >= bytes) {
+                return;
             }
-            size = (len - comma_pos - 1) / base_len + 2;
-            
-            arr = new uint32_t[size];
-            arr[0] = ved;
-
-            for (int q = 1; q < size; ++q) {
-                arr[q] = 0;
+            for (Block& b : blocks) {
+                delete [] b.data;
             }
+            blocks.assign(1, Block{new char[bytes], bytes});
+        }
 
-            for (int q = comma_pos + 1; q < len; ++q) {
-                if ((q - comma_pos - 1) % base_len == 0) {
-                    mult = base;
-                }
-                mult /= 10;
-                arr[1 + ((q - comma_pos - 1) / base_len)] +=
-                                                dti(str[q]) * mult;
-            }
+        Mark mark() const {
+            return Mark{block, offset};
         }
 
-        ~Decimal() {
-            delete [] arr;
+        void release(Mark m) {
+            block = m.block;
+            offset = m.offset;
         }
+};
 
-        Decimal(const Decimal&) = delete;
-        Decimal(const Decimal&&) = delete;
-        void operator=(const Decimal&) = delete;
-        void operator=(const Decimal&&) = delete;
+ScratchArena& scratch_arena() {
+    thread_local ScratchArena arena;
+    return arena;
+}
 
-        Decimal& operator+=(const Decimal& other) {
-            assert(size == other.size);
+// Memory of the arena taken in the scope is released at its end
+class ScratchScope {
+    ScratchArena& arena;
+    ScratchArena::Mark start;
 
-            uint64_t carry = 0;
-            for (std::size_t q = size - 1; q != -1; --q) {
-                arr[q] += other.arr[q] + carry;
-                if (arr[q] >= base) {
-                    arr[q] -= base;
-                    carry = true;
-                } else {
-                    carry = false;
-                }
-                if (!q) {
-                    break;
-                }
-            }
+    public:
+        ScratchScope()
+            : arena(scratch_arena())
+            , start(arena.mark())
+        {}
 
-            return *this;
+        ScratchScope(const ScratchScope&) = delete;
+        void operator=(const ScratchScope&) = delete;
+
+        ~ScratchScope() {
+            arena.release(start);
         }
 
-        Decimal& operator+=(uint32_t other) {
-            arr[0] += other;
-            return *this;
+        // Zeroed array of count elements
+        template <typename T>
+        T* alloc(std::size_t count) {
+            T* ret = static_cast<T*>(arena.alloc(count * sizeof(T)));
+            std::memset(ret, 0, count * sizeof(T));
+            return ret;
         }
+};
 
-        Decimal& operator*=(uint32_t mul) {
-            uint32_t carry = 0;
-            uint64_t extension = 0;
-            for (std::size_t q = size - 1;; --q) {
-                extension = static_cast<uint64_t>(arr[q]) * mul + carry;
-                if (extension >= base) {
-                    carry = extension / base;
-                }
-                arr[q] = extension % base;
-                if (!q) {
-                    break;
-                }
-            }
+/*
+ * Upper bound of the arena for the product of two numbers of the given
+ *    bytes. The NTT takes the most: two transforms of up to 12 digits per
+ *    limb and the table of roots, all of uint64_t.
+ */
+std::size_t mul_scratch_bound(std::size_t bytes) {
+    return 80 * bytes + (1 << 16);
+}
 
-            return *this;
-        }
+/*
+ * Pool of limb arrays of Decimal and BinaryFixed. The numbers of a
+ *    computation have the same few sizes, so a freed array goes to the
+ *    list of its size and the next number of the size takes it without
+ *    the heap. Every thread has its own pool, see LimbPool::local.
+ */
+class LimbPool {
+    struct FreeList {
+        std::size_t bytes;
+        std::vector<void*> arrays;
+    };
 
-        Decimal& operator*=(const Decimal& other) {
-            uint64_t* buf = new uint64_t[size+1];
-            for (int q = 0; q < size + 1; ++q) {
-                buf[q] = 0;
+    std::vector<FreeList> lists;
+
+    FreeList& list(std::size_t bytes) {
+        for (FreeList& l : lists) {
+            if (l.bytes == bytes) {
+                return l;
             }
+        }
+        lists.push_back(FreeList{bytes, {}});
+        return lists.back();
+    }
 
-            for (int k = size; k > 0; --k) {
-                buf[k-1] += buf[k] / base;
-                buf[k] %= base;
-                for (int q = 1; q <= k; ++q) {
-                    uint64_t a = static_cast<uint64_t>(arr[q]);
-                    uint64_t b = static_cast<uint64_t>(other.arr[k-q]);
-                    buf[k] += a * b;
-                    buf[k-1] += buf[k] / base;
-                    buf[k] %= base;
+    public:
+        LimbPool() = default;
+        LimbPool(const LimbPool&) = delete;
+        void operator=(const LimbPool&) = delete;
+
+        ~LimbPool() {
+            for (FreeList& l : lists) {
+                for (void* arr : l.arrays) {
+                    delete [] static_cast<char*>(arr);
                 }
             }
-            buf[0] %= static_cast<uint64_t>(base);
+        }
 
-            for (int q = 0; q < size; ++q) {
-                arr[q] = static_cast<uint32_t>(buf[q]);
-            } 
-            delete [] buf;
-            return *this;
+        static LimbPool& local() {
+            thread_local LimbPool pool;
+            return pool;
         }
 
-        Decimal& operator/=(uint32_t divider) {
-            uint64_t reminder = 0;
-            uint64_t divisible = 0;
-            for (std::size_t q = 0; q < size; ++q) {
-                divisible = reminder * base + arr[q];
-                arr[q] = divisible / divider;
-                reminder = divisible % divider;
+        template <typename T>
+        T* take(std::size_t count) {
+            FreeList& l = list(count * sizeof(T));
+            if (l.arrays.empty()) {
+                return reinterpret_cast<T*>(new char[l.bytes]);
             }
+            void* ret = l.arrays.back();
+            l.arrays.pop_back();
+            return static_cast<T*>(ret);
+        }
 
-            return *this;
+        template <typename T>
+        void give(T* arr, std::size_t count) {
+            list(count * sizeof(T)).arrays.push_back(arr);
         }
 
-        Decimal& divide__(uint32_t divider, int& start) {
-            uint64_t reminder = 0;
-            uint64_t divisible = 0;
-            bool is_prev_z = true;
-            for (std::size_t q = start; q < size; ++q) {
-                divisible = reminder * base + arr[q];
-                arr[q] = divisible / divider;
-                reminder = divisible % divider;
-                if (arr[q] == 0) {
-                    if (is_prev_z) {
-                        start = q;
-                    }
-                } else {
-                    is_prev_z = false;
-                }
+        /*
+         * Puts arrays into the list of the size until it has count ones,
+         *    the list has room for count more, so give doesn't grow it.
+         */
+        void reserve(std::size_t bytes, std::size_t count) {
+            FreeList& l = list(bytes);
+            l.arrays.reserve(2 * count);
+            while (l.arrays.size() < count) {
+                l.arrays.push_back(new char[bytes]);
             }
+        }
+};
 
-            return *this;
+// ------------------------------------------------------ limbs multiplication
+// All functions in this section work with little-endian arrays of limbs
+//    in base LIMB_BASE. Result of the multiplication of na and nb limbs
+//    always takes na + nb limbs.
+
+constexpr uint32_t LIMB_BASE = 1'000'000'000;
+
+// Tier switching points in limbs, see bench_mul
+constexpr std::size_t KARATSUBA_THRESHOLD = 32;
+constexpr std::size_t TOOM3_THRESHOLD = 128;
+constexpr std::size_t NTT_THRESHOLD = 12000;
+// Divisors longer than this are inverted with Newton's iteration
+constexpr std::size_t NEWTON_DIV_THRESHOLD = 200;
+
+enum MulTier {
+    MUL_AUTO,
+    MUL_SCHOOL,
+    MUL_KARATSUBA,
+    MUL_TOOM3,
+    MUL_NTT,
+};
+
+void mul_limbs(const uint32_t* a, std::size_t na,
+               const uint32_t* b, std::size_t nb, uint32_t* ret);
+
+static inline std::size_t limbs_trim(const uint32_t* a, std::size_t n) {
+    while (n > 0 && a[n-1] == 0) {
+        --n;
+    }
+    return n;
+}
+
+static inline int limbs_cmp(const uint32_t* a, std::size_t na,
+                            const uint32_t* b, std::size_t nb) {
+    na = limbs_trim(a, na);
+    nb = limbs_trim(b, nb);
+    if (na != nb) {
+        return na < nb ? -1 : 1;
+    }
+    for (std::size_t q = na; q > 0; --q) {
+        if (a[q-1] != b[q-1]) {
+            return a[q-1] < b[q-1] ? -1 : 1;
         }
+    }
+    return 0;
+}
 
-        bool is_null() {
-            for (int q = size-1; q >= 0 ; --q) {
-                if (arr[q] != 0) {
-                    return false;
-                }
+// a[0..na) += b[0..nb), nb <= na, the sum must fit in na limbs
+static inline void limbs_add_to(uint32_t* a, std::size_t na,
+                                const uint32_t* b, std::size_t nb) {
+    uint32_t carry = 0;
+    std::size_t q = 0;
+    for (; q < nb; ++q) {
+        a[q] += b[q] + carry;
+        carry = a[q] >= LIMB_BASE;
+        a[q] -= carry ? LIMB_BASE : 0;
+    }
+    for (; carry && q < na; ++q) {
+        a[q] += carry;
+        carry = a[q] >= LIMB_BASE;
+        a[q] -= carry ? LIMB_BASE : 0;
+    }
+    assert(!carry);
+}
+
+// a[0..na) -= b[0..nb), nb <= na, requires a >= b
+static inline void limbs_sub_from(uint32_t* a, std::size_t na,
+                                  const uint32_t* b, std::size_t nb) {
+    uint32_t borrow = 0;
+    std::size_t q = 0;
+    for (; q < nb; ++q) {
+        uint32_t sub = b[q] + borrow;
+        borrow = a[q] < sub;
+        a[q] += (borrow ? LIMB_BASE : 0) - sub;
+    }
+    for (; borrow && q < na; ++q) {
+        borrow = a[q] == 0;
+        a[q] = borrow ? LIMB_BASE - 1 : a[q] - 1;
+    }
+    assert(!borrow);
+}
+
+// dst[0..max(na, nb) + 1) = a + b
+static inline void limbs_add(uint32_t* dst, const uint32_t* a, std::size_t na,
+                             const uint32_t* b, std::size_t nb) {
+    if (na < nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    std::memcpy(dst, a, na * sizeof(uint32_t));
+    dst[na] = 0;
+    limbs_add_to(dst, na + 1, b, nb);
+}
+
+// a[0..n) *= mul, the product must fit in n limbs
+static inline void limbs_mul_small(uint32_t* a, std::size_t n, uint32_t mul) {
+    uint64_t carry = 0;
+    for (std::size_t q = 0; q < n; ++q) {
+        carry += static_cast<uint64_t>(a[q]) * mul;
+        a[q] = carry % LIMB_BASE;
+        carry /= LIMB_BASE;
+    }
+    assert(!carry);
+}
+
+// a[0..n) /= div, the division must be exact
+static inline void limbs_div_small(uint32_t* a, std::size_t n, uint32_t div) {
+    uint64_t reminder = 0;
+    for (std::size_t q = n; q > 0; --q) {
+        uint64_t divisible = reminder * LIMB_BASE + a[q-1];
+        a[q-1] = divisible / div;
+        reminder = divisible % div;
+    }
+    assert(!reminder);
+}
+
+static void mul_school(const uint32_t* a, std::size_t na,
+                       const uint32_t* b, std::size_t nb, uint32_t* ret) {
+    for (std::size_t q = 0; q < na + nb; ++q) {
+        ret[q] = 0;
+    }
+
+    // cur <= base^2 - 1, so every carry stays below base
+    for (std::size_t q = 0; q < na; ++q) {
+        uint64_t x = a[q];
+        if (!x) {
+            continue;
+        }
+        uint64_t carry = 0;
+        for (std::size_t w = 0; w < nb; ++w) {
+            uint64_t cur = ret[q+w] + x * b[w] + carry;
+            ret[q+w] = cur % LIMB_BASE;
+            carry = cur / LIMB_BASE;
+        }
+        ret[q + nb] = carry;
+    }
+}
+
+// a = a0 + a1*B^m, b = b0 + b1*B^m, (a0+a1)(b0+b1) - a0*b0 - a1*b1 is
+//    the middle coefficient. Both operands have n limbs.
+static void mul_karatsuba(const uint32_t* a, const uint32_t* b,
+                          std::size_t n, uint32_t* ret) {
+    std::size_t m = n / 2;
+    std::size_t h = n - m;
+
+    mul_limbs(a, m, b, m, ret);
+    mul_limbs(a + m, h, b + m, h, ret + 2*m);
+
+    ScratchScope scratch;
+    uint32_t* sa  = scratch.alloc<uint32_t>(4*h + 4);
+    uint32_t* sb  = sa + h + 1;
+    uint32_t* mid = sb + h + 1;
+    limbs_add(sa, a, m, a + m, h);
+    limbs_add(sb, b, m, b + m, h);
+    mul_limbs(sa, h + 1, sb, h + 1, mid);
+    limbs_sub_from(mid, 2*h + 2, ret, 2*m);
+    limbs_sub_from(mid, 2*h + 2, ret + 2*m, 2*h);
+    limbs_add_to(ret + m, 2*n - m, mid, limbs_trim(mid, 2*h + 2));
+}
+
+/*
+ * Toom-3 with points 0, 1, -1, 2 and infinity. The only signed value is
+ *    the product at -1, so it is kept as magnitude and sign. All other
+ *    steps of the interpolation subtract smaller numbers from larger ones.
+ *    Both operands have n limbs.
+ */
+static void mul_toom3(const uint32_t* a, const uint32_t* b,
+                      std::size_t n, uint32_t* ret) {
+    std::size_t k = (n + 2) / 3;
+    std::size_t l2 = n - 2*k;
+    std::size_t ev = k + 1;          // evaluation length
+    std::size_t w = 2*ev + 1;        // product and interpolation length
+
+    ScratchScope scratch;
+    uint32_t* pa1  = scratch.alloc<uint32_t>(6*ev + 6*w);
+    uint32_t* pam1 = pa1  + ev;
+    uint32_t* pa2  = pam1 + ev;
+    uint32_t* pb1  = pa2  + ev;
+    uint32_t* pbm1 = pb1  + ev;
+    uint32_t* pb2  = pbm1 + ev;
+    uint32_t* r1   = pb2  + ev;
+    uint32_t* rm1  = r1   + w;
+    uint32_t* r2   = rm1  + w;
+    uint32_t* c2   = r2   + w;
+    uint32_t* t    = c2   + w;
+    uint32_t* tmp  = t    + w;
+
+    auto evaluate = [&](const uint32_t* x, uint32_t* p1, uint32_t* pm1,
+                                                    uint32_t* p2) -> bool {
+        const uint32_t* x0 = x;
+        const uint32_t* x1 = x + k;
+        const uint32_t* x2 = x + 2*k;
+
+        // p1 = x0 + x2, pm1 = |x0 + x2 - x1|
+        limbs_add(p1, x0, k, x2, l2);
+        bool neg = limbs_cmp(p1, ev, x1, k) < 0;
+        if (neg) {
+            std::memcpy(pm1, x1, k * sizeof(uint32_t));
+            pm1[k] = 0;
+            limbs_sub_from(pm1, ev, p1, ev);
+        } else {
+            std::memcpy(pm1, p1, ev * sizeof(uint32_t));
+            limbs_sub_from(pm1, ev, x1, k);
+        }
+        limbs_add_to(p1, ev, x1, k);
+
+        // p2 = x0 + 2*(x1 + 2*x2)
+        std::memset(p2, 0, ev * sizeof(uint32_t));
+        std::memcpy(p2, x2, l2 * sizeof(uint32_t));
+        limbs_mul_small(p2, ev, 2);
+        limbs_add_to(p2, ev, x1, k);
+        limbs_mul_small(p2, ev, 2);
+        limbs_add_to(p2, ev, x0, k);
+
+        return neg;
+    };
+    bool neg = evaluate(a, pa1, pam1, pa2) != evaluate(b, pb1, pbm1, pb2);
+
+    std::memset(ret, 0, 2*n * sizeof(uint32_t));
+    mul_limbs(a, k, b, k, ret);                      // c0
+    mul_limbs(a + 2*k, l2, b + 2*k, l2, ret + 4*k);  // c4
+    const uint32_t* c0 = ret;
+    const uint32_t* c4 = ret + 4*k;
+    r1[w-1] = rm1[w-1] = r2[w-1] = 0;
+    mul_limbs(pa1, ev, pb1, ev, r1);
+    mul_limbs(pam1, ev, pbm1, ev, rm1);
+    mul_limbs(pa2, ev, pb2, ev, r2);
+
+    // c2 = (r1 + r(-1))/2 - c0 - c4, t = c1 + c3 = (r1 - r(-1))/2
+    std::memcpy(c2, r1, w * sizeof(uint32_t));
+    std::memcpy(t, r1, w * sizeof(uint32_t));
+    if (neg) {
+        limbs_sub_from(c2, w, rm1, w);
+        limbs_add_to(t, w, rm1, w);
+    } else {
+        limbs_add_to(c2, w, rm1, w);
+        limbs_sub_from(t, w, rm1, w);
+    }
+    limbs_div_small(c2, w, 2);
+    limbs_div_small(t, w, 2);
+    limbs_sub_from(c2, w, c0, 2*k);
+    limbs_sub_from(c2, w, c4, 2*l2);
+
+    // c3 = (r2 - c0 - 4*c2 - 16*c4 - 2*t)/6, the result in r2
+    limbs_sub_from(r2, w, c0, 2*k);
+    std::memcpy(tmp, c2, w * sizeof(uint32_t));
+    limbs_mul_small(tmp, w, 4);
+    limbs_sub_from(r2, w, tmp, w);
+    std::memset(tmp, 0, w * sizeof(uint32_t));
+    std::memcpy(tmp, c4, 2*l2 * sizeof(uint32_t));
+    limbs_mul_small(tmp, w, 16);
+    limbs_sub_from(r2, w, tmp, w);
+    std::memcpy(tmp, t, w * sizeof(uint32_t));
+    limbs_mul_small(tmp, w, 2);
+    limbs_sub_from(r2, w, tmp, w);
+    limbs_div_small(r2, w, 6);
+    limbs_sub_from(t, w, r2, w);
+
+    limbs_add_to(ret + k,   2*n - k,   t,  limbs_trim(t, w));
+    limbs_add_to(ret + 2*k, 2*n - 2*k, c2, limbs_trim(c2, w));
+    limbs_add_to(ret + 3*k, 2*n - 3*k, r2, limbs_trim(r2, w));
+}
+
+/*
+ * Number-theoretic transform modulo the prime 2^64 - 2^32 + 1. Limbs are
+ *    split into base 1000 digits, so the coefficients of the product
+ *    are below 10^6 * count and never exceed the modulus.
+ */
+namespace ntt {
+    constexpr uint64_t mod = 0xFFFF'FFFF'0000'0001ull;
+    constexpr uint64_t generator = 7;
+    constexpr uint32_t digit_base = 1000;
+
+    static inline uint64_t reduce(unsigned __int128 x) {
+        uint64_t lo = static_cast<uint64_t>(x);
+        uint64_t hi = static_cast<uint64_t>(x >> 64);
+        uint64_t hi_hi = hi >> 32;
+        uint64_t hi_lo = hi & 0xFFFF'FFFFull;
+
+        // 2^64 = 2^32 - 1 and 2^96 = -1 modulo mod
+        uint64_t t0 = lo - hi_hi;
+        if (lo < hi_hi) {
+            t0 -= 0xFFFF'FFFFull;
+        }
+        uint64_t t1 = hi_lo * 0xFFFF'FFFFull;
+        uint64_t ret = t0 + t1;
+        if (ret < t1) {
+            ret += 0xFFFF'FFFFull;
+        }
+        return ret >= mod ? ret - mod : ret;
+    }
+
+    static inline uint64_t mul(uint64_t a, uint64_t b) {
+        return reduce(static_cast<unsigned __int128>(a) * b);
+    }
+
+    static inline uint64_t add(uint64_t a, uint64_t b) {
+        uint64_t ret = a + b;
+        if (ret < a || ret >= mod) {
+            ret -= mod;
+        }
+        return ret;
+    }
+
+    static inline uint64_t sub(uint64_t a, uint64_t b) {
+        return a >= b ? a - b : a + (mod - b);
+    }
+
+    static uint64_t pow(uint64_t a, uint64_t e) {
+        uint64_t ret = 1;
+        while (e) {
+            if (e & 1) {
+                ret = mul(ret, a);
             }
-            return true;
+            a = mul(a, a);
+            e >>= 1;
         }
+        return ret;
+    }
 
-        friend std::ostream& operator<<(std::ostream& out,
-                                                    const Decimal& num) {
-            out << num.arr[0] << '.';
-            for (std::size_t q = 1; q < num.size; ++q) {
-                out << std::setw(base_len) << std::setfill('0')
-                                                    << num.arr[q] << "";
+    static void transform(uint64_t* arr, std::size_t n, bool inverse) {
+        for (std::size_t q = 1, w = 0; q < n; ++q) {
+            std::size_t bit = n >> 1;
+            for (; w & bit; bit >>= 1) {
+                w ^= bit;
+            }
+            w ^= bit;
+            if (q < w) {
+                std::swap(arr[q], arr[w]);
             }
+        }
 
-            return out;
+        ScratchScope scratch;
+        uint64_t* roots = scratch.alloc<uint64_t>(n / 2);
+        for (std::size_t len = 2; len <= n; len <<= 1) {
+            uint64_t root = pow(generator, (mod - 1) / len);
+            if (inverse) {
+                root = pow(root, mod - 2);
+            }
+            std::size_t half = len / 2;
+            roots[0] = 1;
+            for (std::size_t q = 1; q < half; ++q) {
+                roots[q] = mul(roots[q-1], root);
+            }
+            for (std::size_t q = 0; q < n; q += len) {
+                for (std::size_t w = 0; w < half; ++w) {
+                    uint64_t u = arr[q + w];
+                    uint64_t v = mul(arr[q + w + half], roots[w]);
+                    arr[q + w] = add(u, v);
+                    arr[q + w + half] = sub(u, v);
+                }
+            }
         }
 
-        uint32_t* get_arr() {
-            return arr;
+        if (inverse) {
+            uint64_t inv_n = pow(n, mod - 2);
+            for (std::size_t q = 0; q < n; ++q) {
+                arr[q] = mul(arr[q], inv_n);
+            }
         }
+    }
 
-        std::size_t get_size() const {
-            return size;
+    static void split_digits(const uint32_t* a, std::size_t na,
+                                                            uint64_t* ret) {
+        for (std::size_t q = 0; q < na; ++q) {
+            uint32_t limb = a[q];
+            ret[3*q]     = limb % digit_base;
+            ret[3*q + 1] = limb / digit_base % digit_base;
+            ret[3*q + 2] = limb / (digit_base * digit_base);
         }
+    }
+}
 
-        std::size_t get_type_size() const {
-            return sizeof(arr[0]);
+static void mul_ntt(const uint32_t* a, std::size_t na,
+                    const uint32_t* b, std::size_t nb, uint32_t* ret) {
+    std::size_t digits = 3 * (na + nb);
+    std::size_t n = 1;
+    while (n < digits) {
+        n <<= 1;
+    }
+
+    ScratchScope scratch;
+    uint64_t* fa = scratch.alloc<uint64_t>(n);
+    uint64_t* fb = scratch.alloc<uint64_t>(n);
+    ntt::split_digits(a, na, fa);
+    ntt::split_digits(b, nb, fb);
+    ntt::transform(fa, n, false);
+    ntt::transform(fb, n, false);
+    for (std::size_t q = 0; q < n; ++q) {
+        fa[q] = ntt::mul(fa[q], fb[q]);
+    }
+    ntt::transform(fa, n, true);
+
+    uint64_t carry = 0;
+    for (std::size_t q = 0; q < na + nb; ++q) {
+        uint32_t limb = 0;
+        uint32_t mult = 1;
+        for (std::size_t w = 0; w < 3; ++w) {
+            carry += fa[3*q + w];
+            limb += (carry % ntt::digit_base) * mult;
+            carry /= ntt::digit_base;
+            mult *= ntt::digit_base;
         }
+        ret[q] = limb;
+    }
+    assert(!carry);
+}
+
+static void mul_unbalanced(const uint32_t* a, std::size_t na,
+                           const uint32_t* b, std::size_t nb, uint32_t* ret) {
+    // a is splitted into chunks of nb limbs
+    std::memset(ret, 0, (na + nb) * sizeof(uint32_t));
+    ScratchScope scratch;
+    uint32_t* part = scratch.alloc<uint32_t>(2 * nb);
+    for (std::size_t off = 0; off < na; off += nb) {
+        std::size_t len = std::min(nb, na - off);
+        mul_limbs(a + off, len, b, nb, part);
+        limbs_add_to(ret + off, na + nb - off, part, len + nb);
+    }
+}
+
+void mul_limbs_tier(MulTier tier,
+                    const uint32_t* a, std::size_t na,
+                    const uint32_t* b, std::size_t nb, uint32_t* ret) {
+    if (na < nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    if (nb == 0) {
+        std::memset(ret, 0, na * sizeof(uint32_t));
+        return;
+    }
+
+    if (tier == MUL_AUTO) {
+        if (nb < KARATSUBA_THRESHOLD) {
+            tier = MUL_SCHOOL;
+        } else if (nb >= NTT_THRESHOLD) {
+            tier = MUL_NTT;
+        } else if (na != nb) {
+            mul_unbalanced(a, na, b, nb, ret);
+            return;
+        } else if (nb >= TOOM3_THRESHOLD) {
+            tier = MUL_TOOM3;
+        } else {
+            tier = MUL_KARATSUBA;
+        }
+    }
+
+    switch (tier) {
+        case MUL_SCHOOL:
+            mul_school(a, na, b, nb, ret);
+            break;
+        case MUL_KARATSUBA:
+        case MUL_TOOM3:
+            if (na != nb || nb < 3) {
+                mul_unbalanced(a, na, b, nb, ret);
+            } else if (tier == MUL_KARATSUBA) {
+                mul_karatsuba(a, b, nb, ret);
+            } else {
+                mul_toom3(a, b, nb, ret);
+            }
+            break;
+        case MUL_NTT:
+            mul_ntt(a, na, b, nb, ret);
+            break;
+        default:
+            check_ames(0, "Unknown multiplication tier");
+    }
+}
+
+void mul_limbs(const uint32_t* a, std::size_t na,
+               const uint32_t* b, std::size_t nb, uint32_t* ret) {
+    mul_limbs_tier(MUL_AUTO, a, na, b, nb, ret);
+}
+
+// ---------------------------------------------------------- limbs addition
+
+enum AddKernel {
+    ADD_AUTO,
+    ADD_SCALAR,
+    ADD_AVX2,
+    ADD_AVX512,
+};
+
+// a += b on n big-endian limbs, returns the carry out of a[0]
+static uint32_t add_dec_scalar(uint32_t* a, const uint32_t* b,
+                                                            std::size_t n) {
+    uint32_t carry = 0;
+    for (std::size_t q = n; q > 0; --q) {
+        a[q-1] += b[q-1] + carry;
+        carry = a[q-1] >= LIMB_BASE;
+        a[q-1] -= carry ? LIMB_BASE : 0;
+    }
+    return carry;
+}
+
+#ifdef __x86_64__
+/*
+ * The vector kernels add a block of limbs without carries and take two
+ *    lane masks: g - the sum is not less than the base, p - the sum is
+ *    base - 1 and passes the incoming carry on. With the least
+ *    significant limb in bit 0 and m = g | p, the carries into the limbs
+ *    are the bits of (m + g + carry_in) ^ m ^ g: the binary addition
+ *    resolves the whole chain of the block at once, the carry out of the
+ *    block is its overflow bit. The lanes are reversed for that order.
+ */
+__attribute__((target("avx2")))
+static uint32_t add_dec_avx2(uint32_t* a, const uint32_t* b, std::size_t n) {
+    const __m256i base = _mm256_set1_epi32(LIMB_BASE);
+    const __m256i top = _mm256_set1_epi32(LIMB_BASE - 1);
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+
+    uint32_t carry = 0;
+    std::size_t q = n;
+    while (q >= 8) {
+        q -= 8;
+        __m256i sum = _mm256_add_epi32(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + q)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + q))
+        );
+        sum = _mm256_permutevar8x32_epi32(sum, reverse);
+
+        // The sums are less than 2^31, the signed compare is enough
+        uint32_t g = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpgt_epi32(sum, top))
+        );
+        uint32_t p = _mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(sum, top))
+        );
+        uint32_t chain = ((g | p) + g + carry) ^ (g | p) ^ g;
+        carry = chain >> 8;
+
+        __m256i in = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(chain), bits), bits
+        );
+        __m256i out = _mm256_cmpeq_epi32(
+            _mm256_and_si256(_mm256_set1_epi32(chain >> 1), bits), bits
+        );
+        sum = _mm256_sub_epi32(sum, in);
+        sum = _mm256_sub_epi32(sum, _mm256_and_si256(out, base));
+
+        sum = _mm256_permutevar8x32_epi32(sum, reverse);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a + q), sum);
+    }
+
+    for (; q > 0; --q) {
+        a[q-1] += b[q-1] + carry;
+        carry = a[q-1] >= LIMB_BASE;
+        a[q-1] -= carry ? LIMB_BASE : 0;
+    }
+    return carry;
+}
+
+__attribute__((target("avx512f")))
+static uint32_t add_dec_avx512(uint32_t* a, const uint32_t* b,
+                                                            std::size_t n) {
+    const __m512i base = _mm512_set1_epi32(LIMB_BASE);
+    const __m512i top = _mm512_set1_epi32(LIMB_BASE - 1);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i reverse = _mm512_setr_epi32(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0
+    );
+
+    uint32_t carry = 0;
+    std::size_t q = n;
+    while (q >= 16) {
+        q -= 16;
+        __m512i sum = _mm512_add_epi32(
+            _mm512_loadu_si512(a + q), _mm512_loadu_si512(b + q)
+        );
+        sum = _mm512_maskz_permutexvar_epi32(0xFFFF, reverse, sum);
+
+        uint32_t g = _mm512_cmpgt_epu32_mask(sum, top);
+        uint32_t p = _mm512_cmpeq_epu32_mask(sum, top);
+        uint32_t chain = ((g | p) + g + carry) ^ (g | p) ^ g;
+        carry = chain >> 16;
+
+        sum = _mm512_mask_add_epi32(
+            sum, static_cast<__mmask16>(chain), sum, one
+        );
+        sum = _mm512_mask_sub_epi32(
+            sum, static_cast<__mmask16>(chain >> 1), sum, base
+        );
+
+        sum = _mm512_maskz_permutexvar_epi32(0xFFFF, reverse, sum);
+        _mm512_storeu_si512(a + q, sum);
+    }
+
+    for (; q > 0; --q) {
+        a[q-1] += b[q-1] + carry;
+        carry = a[q-1] >= LIMB_BASE;
+        a[q-1] -= carry ? LIMB_BASE : 0;
+    }
+    return carry;
+}
+#endif
+
+bool add_kernel_supported(AddKernel kernel) {
+    switch (kernel) {
+        case ADD_AUTO:
+        case ADD_SCALAR:
+            return true;
+#ifdef __x86_64__
+        case ADD_AVX2:
+            return __builtin_cpu_supports("avx2");
+        case ADD_AVX512:
+            return __builtin_cpu_supports("avx512f");
+#endif
+        default:
+            return false;
+    }
+}
+
+// The widest kernel of the CPU, it is found once
+static AddKernel add_kernel_best() {
+    static const AddKernel best =
+        add_kernel_supported(ADD_AVX512) ? ADD_AVX512 :
+        add_kernel_supported(ADD_AVX2) ? ADD_AVX2 : ADD_SCALAR;
+    return best;
+}
+
+uint32_t add_dec_kernel(AddKernel kernel,
+                        uint32_t* a, const uint32_t* b, std::size_t n) {
+    if (kernel == ADD_AUTO) {
+        kernel = add_kernel_best();
+    }
+
+    switch (kernel) {
+        case ADD_SCALAR:
+            return add_dec_scalar(a, b, n);
+#ifdef __x86_64__
+        case ADD_AVX2:
+            return add_dec_avx2(a, b, n);
+        case ADD_AVX512:
+            return add_dec_avx512(a, b, n);
+#endif
+        default:
+            check_ames(0, "Unknown addition kernel");
+            return 0;
+    }
+}
+
+uint32_t add_dec(uint32_t* a, const uint32_t* b, std::size_t n) {
+    return add_dec_kernel(ADD_AUTO, a, b, n);
+}
+
+/*
+ * Division of uint64_t values by an invariant uint32_t divisor through
+ *    a precomputed reciprocal (Granlund and Montgomery). m = (2^64-1)/d,
+ *    the high half of n*m is less than n/d by at most one for n < 2^63,
+ *    so one branchless correction gives the exact quotient.
+ */
+class Reciprocal {
+    uint64_t divider;
+    uint64_t mult;
+
+    public:
+        explicit Reciprocal(uint32_t divider)
+            : divider(divider)
+            , mult(~0ull / divider)
+        {
+            assert(divider != 0);
+        }
+
+        // Division by 1, it is for arrays of reciprocals
+        Reciprocal()
+            : Reciprocal(1)
+        {}
+
+        // Returns n / divider and writes n % divider into rem
+        inline uint64_t divmod(uint64_t n, uint64_t& rem) const {
+            assert(n < (1ull << 63));
+            uint64_t quot = static_cast<uint64_t>(
+                (static_cast<unsigned __int128>(n) * mult) >> 64
+            );
+            rem = n - quot * divider;
+            uint64_t fix = rem >= divider;
+            quot += fix;
+            rem -= fix * divider;
+            return quot;
+        }
+};
+
+/*
+ * Output of the digits: limbs are converted into one buffer, which is
+ *    written by one system call instead of setw/setfill per limb.
+ */
+static const char DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes limb < 10^9 as exactly 9 characters, two digits per step
+inline char* limb_to_chars(uint32_t limb, char* out) {
+    for (int q = 3; q >= 0; --q) {
+        std::memcpy(out + 1 + 2*q, DIGIT_PAIRS + 2*(limb % 100), 2);
+        limb /= 100;
+    }
+    out[0] = static_cast<char>('0' + limb);
+    return out + 9;
+}
+
+// Writes the whole buffer, write is repeated only on a partial write
+void write_file(const char* path, const char* buf, std::size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    check_ames(fd >= 0, "Can't open the output file");
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        check_ames(written > 0, "Can't write the output file");
+        buf += written;
+        len -= written;
+    }
+    close(fd);
+}
+
+class Decimal {
+    static_assert(sizeof(uint32_t) == 4);
+    static_assert(sizeof(uint64_t) == 8);
+
+    static constexpr uint32_t base = LIMB_BASE;
+    static constexpr uint32_t base_len = 9;
+
+    std::size_t size = 0;
+    uint32_t *arr = nullptr;
+
+    public:
+        using Limb = uint32_t;
+
+        Decimal(uint32_t a, std::size_t digits)
+            : size(digits)
+            , arr(LimbPool::local().take<uint32_t>(size))
+        {
+            for (int q = 0; q < size; ++q) {
+                arr[q] = 0;
+            }
+            arr[0] = a;
+        }
+
+        static int dti(char digit) {
+            return digit - '0';
+        }
+
+        Decimal(const char* str) {
+            std::size_t len = std::strlen(str);
+
+            int comma_pos = 0;
+            uint32_t ved = 0;
+            while (str[++comma_pos] != '.') {}
+            uint32_t mult = 1;
+            for (int q = comma_pos; q > 0; --q) {
+                ved += dti(str[q-1]) * mult;
+                mult *= 10;
+            }
+            size = (len - comma_pos - 1) / base_len + 2;
+            
+            arr = LimbPool::local().take<uint32_t>(size);
+            arr[0] = ved;
+
+            for (int q = 1; q < size; ++q) {
+                arr[q] = 0;
+            }
+
+            for (int q = comma_pos + 1; q < len; ++q) {
+                if ((q - comma_pos - 1) % base_len == 0) {
+                    mult = base;
+                }
+                mult /= 10;
+                arr[1 + ((q - comma_pos - 1) / base_len)] +=
+                                                dti(str[q]) * mult;
+            }
+        }
+
+        ~Decimal() {
+            if (arr) {
+                LimbPool::local().give(arr, size);
+            }
+        }
+
+        Decimal(const Decimal&) = delete;
+        void operator=(const Decimal&) = delete;
+
+        // The moved-from number has no limbs and may be only destroyed
+        Decimal(Decimal&& other)
+            : size(other.size)
+            , arr(other.arr)
+        {
+            other.size = 0;
+            other.arr = nullptr;
+        }
+
+        Decimal& operator=(Decimal&& other) {
+            std::swap(size, other.size);
+            std::swap(arr, other.arr);
+            return *this;
+        }
+
+        // The overflow of the integer part is lost
+        Decimal& operator+=(const Decimal& other) {
+            assert(size == other.size);
+            add_dec(arr, other.arr, size);
+            return *this;
+        }
+
+        /*
+         * The same as += when limbs of other before from are zeros. Only
+         *    the live window [from, size) is walked, the carry goes up
+         *    while it is not zero.
+         */
+        Decimal& add_window(const Decimal& other, std::size_t from) {
+            assert(size == other.size);
+
+            uint32_t carry = add_dec(arr + from, other.arr + from,
+                                                                size - from);
+            std::size_t q = from;
+            while (carry && q > 0) {
+                --q;
+                arr[q] += carry;
+                carry = arr[q] >= base;
+                arr[q] -= carry ? base : 0;
+            }
+
+            return *this;
+        }
+
+        // The same as add_window, but other is subtracted, this >= other
+        Decimal& sub_window(const Decimal& other, std::size_t from) {
+            assert(size == other.size);
+
+            uint32_t borrow = 0;
+            std::size_t q = size;
+            while (q > from) {
+                --q;
+                uint32_t sub = other.arr[q] + borrow;
+                borrow = arr[q] < sub;
+                arr[q] = borrow ? arr[q] + base - sub : arr[q] - sub;
+            }
+            while (borrow && q > 0) {
+                --q;
+                borrow = arr[q] == 0;
+                arr[q] = borrow ? base - 1 : arr[q] - 1;
+            }
+
+            return *this;
+        }
+
+        // Copies other, its limbs before from must be zeros
+        void assign_window(const Decimal& other, std::size_t from) {
+            assert(size == other.size);
+            std::memset(arr, 0, from * sizeof(uint32_t));
+            std::memcpy(arr + from, other.arr + from,
+                                        (size - from) * sizeof(uint32_t));
+        }
+
+        Decimal& operator+=(uint32_t other) {
+            arr[0] += other;
+            return *this;
+        }
+
+        Decimal& operator*=(uint32_t mul) {
+            uint32_t carry = 0;
+            uint64_t extension = 0;
+            for (std::size_t q = size - 1;; --q) {
+                extension = static_cast<uint64_t>(arr[q]) * mul + carry;
+                carry = extension / base;
+                arr[q] = extension % base;
+                if (!q) {
+                    break;
+                }
+            }
+
+            return *this;
+        }
+
+        // Fixed-point product, the overflow of the integer part is lost
+        Decimal& operator*=(const Decimal& other) {
+            assert(size == other.size);
+            ScratchScope scratch;
+            uint32_t* a = scratch.alloc<uint32_t>(4*size);
+            uint32_t* b = a + size;
+            uint32_t* prod = b + size;
+            for (std::size_t q = 0; q < size; ++q) {
+                a[q] = arr[size - 1 - q];
+                b[q] = other.arr[size - 1 - q];
+            }
+
+            // Leading zero limbs of the small terms are skipped
+            std::size_t na = limbs_trim(a, size);
+            std::size_t nb = limbs_trim(b, size);
+            mul_limbs(a, na, b, nb, prod);
+            std::memset(prod + na + nb, 0,
+                                    (2*size - na - nb) * sizeof(uint32_t));
+
+            // prod = this * other * base^(size-1)
+            for (std::size_t q = 0; q < size; ++q) {
+                arr[q] = prod[2*size - 2 - q];
+            }
+            return *this;
+        }
+
+        /*
+         * Adds other times the row of len limbs, which stand at positions
+         *    [from, from + len) of a fixed-point number. The limbs before
+         *    frontier are frozen: what falls there is not added but
+         *    returned as the amount for the limb frontier - 1. With zero
+         *    frontier the overflow of the integer part is lost as in *=.
+         */
+        uint32_t add_mul_window(const uint32_t* row, std::size_t len,
+                                std::size_t from, const Decimal& other,
+                                std::size_t frontier) {
+            assert(from + len <= size);
+            std::size_t nb = size - from;
+            ScratchScope scratch;
+            uint32_t* a = scratch.alloc<uint32_t>(2*len + 2*nb);
+            uint32_t* b = a + len;
+            uint32_t* prod = b + nb;
+            for (std::size_t q = 0; q < len; ++q) {
+                a[q] = row[len - 1 - q];
+            }
+            for (std::size_t q = 0; q < nb; ++q) {
+                b[q] = other.arr[nb - 1 - q];
+            }
+
+            std::size_t na = limbs_trim(a, len);
+            std::size_t nt = limbs_trim(b, nb);
+            if (!na || !nt) {
+                return 0;
+            }
+            mul_limbs(a, na, b, nt, prod);
+            std::memset(prod + na + nt, 0,
+                                    (len + nb - na - nt) * sizeof(uint32_t));
+
+            // prod[z] stands at position size + len - 2 - z, from - 1 is
+            //    the highest one
+            uint32_t carry = 0;
+            std::size_t q = size;
+            std::size_t low = std::max(frontier, from ? from - 1 : 0);
+            while (q > low) {
+                --q;
+                arr[q] += prod[size + len - 2 - q] + carry;
+                carry = arr[q] >= base;
+                arr[q] -= carry ? base : 0;
+            }
+            while (carry && q > frontier) {
+                --q;
+                arr[q] += carry;
+                carry = arr[q] >= base;
+                arr[q] -= carry ? base : 0;
+            }
+            if (!frontier) {
+                return 0;
+            }
+
+            uint64_t pending = carry;
+            if (frontier >= from) {
+                pending += prod[size + len - 1 - frontier];
+            }
+            for (std::size_t z = size + len - frontier; z < len + nb; ++z) {
+                pending += static_cast<uint64_t>(prod[z]) * base;
+            }
+            check_ames(pending < base, "The frozen carry overflows a limb");
+            return static_cast<uint32_t>(pending);
+        }
+
+        // The old quadratic multiplication, it is kept for bench_mul
+        Decimal& mul_legacy(const Decimal& other) {
+            uint64_t* buf = new uint64_t[size+1];
+            for (int q = 0; q < size + 1; ++q) {
+                buf[q] = 0;
+            }
+
+            for (int k = size; k > 0; --k) {
+                buf[k-1] += buf[k] / base;
+                buf[k] %= base;
+                for (int q = 1; q <= k && q < size; ++q) {
+                    uint64_t a = static_cast<uint64_t>(arr[q]);
+                    uint64_t b = static_cast<uint64_t>(other.arr[k-q]);
+                    buf[k] += a * b;
+                    buf[k-1] += buf[k] / base;
+                    buf[k] %= base;
+                }
+            }
+            buf[0] %= static_cast<uint64_t>(base);
+
+            for (int q = 0; q < size; ++q) {
+                arr[q] = static_cast<uint32_t>(buf[q]);
+            } 
+            delete [] buf;
+            return *this;
+        }
+
+        Decimal& operator/=(uint32_t divider) {
+            Reciprocal recip{divider};
+            uint64_t reminder = 0;
+            uint64_t divisible = 0;
+            for (std::size_t q = 0; q < size; ++q) {
+                divisible = reminder * base + arr[q];
+                arr[q] = recip.divmod(divisible, reminder);
+            }
+
+            return *this;
+        }
+
+        Decimal& divide__(uint32_t divider, int& start) {
+            Reciprocal recip{divider};
+            uint64_t reminder = 0;
+            uint64_t divisible = 0;
+            bool is_prev_z = true;
+            for (std::size_t q = start; q < size; ++q) {
+                divisible = reminder * base + arr[q];
+                arr[q] = recip.divmod(divisible, reminder);
+                if (arr[q] == 0) {
+                    if (is_prev_z) {
+                        start = q;
+                    }
+                } else {
+                    is_prev_z = false;
+                }
+            }
+
+            return *this;
+        }
+
+        /*
+         * Fused step and accumulate of count terms in one pass: divs are
+         *    the running products k, k(k+1), ... of the divisors, this is
+         *    divided by the last one and every quotient this / divs[w] is
+         *    added to acc. The quotients are the same as after count
+         *    divide__ calls, floor(floor(x/a)/b) = floor(x/(ab)). The
+         *    limb acc[q-1] is held in prev until the carry of acc[q] is
+         *    known, the carry goes further only past base - 1.
+         */
+        template <int count>
+        Decimal& divide_accumulate__(const uint32_t* divs, Decimal& acc,
+                                                                int& start) {
+            assert(size == acc.size);
+            Reciprocal recips[count];
+            uint64_t reminders[count];
+            for (int w = 0; w < count; ++w) {
+                recips[w] = Reciprocal{divs[w]};
+                reminders[w] = 0;
+            }
+
+            bool is_prev_z = true;
+            uint32_t prev = start ? acc.arr[start - 1] : 0;
+            for (std::size_t q = start; q < size; ++q) {
+                uint64_t sum = acc.arr[q];
+                uint64_t quot = 0;
+                for (int w = 0; w < count; ++w) {
+                    quot = recips[w].divmod(
+                        reminders[w] * base + arr[q], reminders[w]
+                    );
+                    sum += quot;
+                }
+                arr[q] = static_cast<uint32_t>(quot);
+
+                uint32_t carry = static_cast<uint32_t>(sum / base);
+                prev += carry;
+                if (prev >= base) {
+                    prev -= base;
+                    std::size_t w = q - 1;
+                    while (w > 0 && ++acc.arr[--w] == base) {
+                        acc.arr[w] = 0;
+                    }
+                }
+                if (q) {
+                    acc.arr[q-1] = prev;
+                }
+                prev = static_cast<uint32_t>(sum - carry * base);
+
+                if (arr[q] == 0) {
+                    if (is_prev_z) {
+                        start = q;
+                    }
+                } else {
+                    is_prev_z = false;
+                }
+            }
+            acc.arr[size - 1] = prev;
+
+            return *this;
+        }
+
+        /*
+         * The pair of divide__: multiplies the limbs after start, the carry
+         *    goes to the leading zeros and start moves before it. The
+         *    integer part must not overflow.
+         */
+        Decimal& multiply__(uint32_t mul, int& start) {
+            uint64_t carry = 0;
+            std::size_t q = size;
+            while (q > static_cast<std::size_t>(start)) {
+                --q;
+                uint64_t extension = static_cast<uint64_t>(arr[q]) * mul
+                                                                    + carry;
+                carry = extension / base;
+                arr[q] = extension % base;
+            }
+            while (carry && q > 0) {
+                --q;
+                arr[q] = carry % base;
+                carry /= base;
+            }
+            assert(carry == 0);
+            start = (q > 0 && arr[q] != 0) ? q - 1 : q;
+
+            return *this;
+        }
+
+        // divide__ with the hardware division, it is kept for bench_div
+        Decimal& divide_hw__(uint32_t divider, int& start) {
+            uint64_t reminder = 0;
+            uint64_t divisible = 0;
+            bool is_prev_z = true;
+            for (std::size_t q = start; q < size; ++q) {
+                divisible = reminder * base + arr[q];
+                arr[q] = divisible / divider;
+                reminder = divisible % divider;
+                if (arr[q] == 0) {
+                    if (is_prev_z) {
+                        start = q;
+                    }
+                } else {
+                    is_prev_z = false;
+                }
+            }
+
+            return *this;
+        }
+
+        bool is_null() {
+            for (int q = size-1; q >= 0 ; --q) {
+                if (arr[q] != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Upper bound of the to_chars length
+        std::size_t chars_bound() const {
+            return 11 + base_len * (size - 1);
+        }
+
+        char* to_chars(char* out) const {
+            out += std::sprintf(out, "%u.", arr[0]);
+            for (std::size_t q = 1; q < size; ++q) {
+                out = limb_to_chars(arr[q], out);
+            }
+            return out;
+        }
+
+        friend std::ostream& operator<<(std::ostream& out,
+                                                    const Decimal& num) {
+            out << num.arr[0] << '.';
+            for (std::size_t q = 1; q < num.size; ++q) {
+                out << std::setw(base_len) << std::setfill('0')
+                                                    << num.arr[q] << "";
+            }
+
+            return out;
+        }
+
+        uint32_t* get_arr() {
+            return arr;
+        }
+
+        std::size_t get_size() const {
+            return size;
+        }
+
+        std::size_t get_type_size() const {
+            return sizeof(arr[0]);
+        }
+
+        static uint32_t get_base() {
+            return base;
+        }
+
+        static uint32_t get_base_len() {
+            return base_len;
+        }
+};
+
+/*
+ * Unbounded unsigned integer with the same radix as Decimal. Limbs are
+ *    stored from the least significant one. It is used by the binary
+ *    splitting where all the sums are kept as exact fractions P/Q.
+ */
+class BigInt {
+    static constexpr uint32_t base = LIMB_BASE;
+
+    std::size_t size = 0;
+    std::size_t capacity = 0;
+    uint32_t *arr = nullptr;
+
+    void normalize() {
+        while (size > 1 && arr[size-1] == 0) {
+            --size;
+        }
+    }
+
+    public:
+        BigInt(uint32_t a = 0)
+            : size(1)
+            , capacity(1)
+            , arr(new uint32_t[capacity])
+        {
+            arr[0] = a;
+            if (a >= base) {
+                reserve(2);
+                arr[0] = a % base;
+                arr[1] = a / base;
+                size = 2;
+            }
+        }
+
+        ~BigInt() {
+            delete [] arr;
+        }
+
+        BigInt(const BigInt&) = delete;
+        void operator=(const BigInt&) = delete;
+
+        BigInt(BigInt&& other)
+            : size(other.size)
+            , capacity(other.capacity)
+            , arr(other.arr)
+        {
+            other.size = 0;
+            other.capacity = 0;
+            other.arr = nullptr;
+        }
+
+        BigInt& operator=(BigInt&& other) {
+            std::swap(size, other.size);
+            std::swap(capacity, other.capacity);
+            std::swap(arr, other.arr);
+            return *this;
+        }
+
+        void reserve(std::size_t new_capacity) {
+            if (new_capacity <= capacity) {
+                return;
+            }
+            uint32_t *new_arr = new uint32_t[new_capacity];
+            std::memcpy(new_arr, arr, size * sizeof(uint32_t));
+            delete [] arr;
+            arr = new_arr;
+            capacity = new_capacity;
+        }
+
+        // Sets count of limbs, new limbs are not initialized
+        void resize(std::size_t new_size) {
+            reserve(new_size);
+            size = new_size;
+        }
+
+        BigInt& operator*=(uint32_t mul) {
+            uint64_t carry = 0;
+            for (std::size_t q = 0; q < size; ++q) {
+                uint64_t extension = static_cast<uint64_t>(arr[q]) * mul
+                                                                    + carry;
+                arr[q] = extension % base;
+                carry = extension / base;
+            }
+            while (carry) {
+                reserve(2 * size);
+                arr[size++] = carry % base;
+                carry /= base;
+            }
+            normalize();
+
+            return *this;
+        }
+
+        BigInt& operator+=(uint32_t other) {
+            uint64_t carry = other;
+            for (std::size_t q = 0; q < size && carry; ++q) {
+                carry += arr[q];
+                arr[q] = carry % base;
+                carry /= base;
+            }
+            if (carry) {
+                reserve(2 * size);
+                arr[size++] = carry;
+            }
+
+            return *this;
+        }
+
+        BigInt& operator+=(const BigInt& other) {
+            std::size_t max_size = std::max(size, other.size);
+            reserve(max_size + 1);
+            for (std::size_t q = size; q < max_size + 1; ++q) {
+                arr[q] = 0;
+            }
+            size = max_size + 1;
+
+            uint32_t carry = 0;
+            for (std::size_t q = 0; q < size; ++q) {
+                uint32_t add = q < other.size ? other.arr[q] : 0;
+                arr[q] += add + carry;
+                if (arr[q] >= base) {
+                    arr[q] -= base;
+                    carry = 1;
+                } else {
+                    carry = 0;
+                }
+            }
+            normalize();
+
+            return *this;
+        }
+
+        static void mul(const BigInt& a, const BigInt& b, BigInt& ret) {
+            assert(&ret != &a && &ret != &b);
+            ret.resize(a.size + b.size);
+            mul_limbs(a.arr, a.size, b.arr, b.size, ret.arr);
+            ret.normalize();
+        }
+
+        // this -= other, requires this >= other
+        BigInt& operator-=(const BigInt& other) {
+            assert(cmp(*this, other) >= 0);
+            limbs_sub_from(arr, size, other.arr, other.size);
+            normalize();
+
+            return *this;
+        }
+
+        static int cmp(const BigInt& a, const BigInt& b) {
+            return limbs_cmp(a.arr, a.size, b.arr, b.size);
+        }
+
+        // Copies count of the most significant limbs of other
+        void assign_top(const BigInt& other, std::size_t count) {
+            count = std::min(count, other.size);
+            resize(count);
+            std::memcpy(arr, other.arr + other.size - count,
+                                                    count * sizeof(uint32_t));
+        }
+
+        // Sets limbs of the fixed-point number (ret of div_fixed)
+        void assign_fixed(const uint32_t* src, std::size_t count) {
+            resize(count);
+            for (std::size_t q = 0; q < count; ++q) {
+                arr[q] = src[count - 1 - q];
+            }
+            normalize();
+        }
+
+        // this = base^power
+        void assign_power(std::size_t power) {
+            resize(power + 1);
+            std::memset(arr, 0, power * sizeof(uint32_t));
+            arr[power] = 1;
+        }
+
+        // Multiplies by base^shift, negative shift drops lower limbs
+        void shift_limbs(long shift) {
+            if (shift >= 0) {
+                std::size_t old_size = size;
+                resize(size + shift);
+                std::memmove(arr + shift, arr, old_size * sizeof(uint32_t));
+                std::memset(arr, 0, shift * sizeof(uint32_t));
+            } else if (static_cast<std::size_t>(-shift) >= size) {
+                size = 1;
+                arr[0] = 0;
+            } else {
+                size -= -shift;
+                std::memmove(arr, arr - shift, size * sizeof(uint32_t));
+            }
+            normalize();
+        }
+
+        // quot = floor(num/den), Knuth's algorithm D
+        static void div_knuth(const BigInt& num, const BigInt& den,
+                                                            BigInt& quot) {
+            assert(!den.is_null());
+            std::size_t n = den.size;
+            std::size_t m = num.size;
+            if (m < n) {
+                quot = BigInt{0};
+                return;
+            }
+            std::size_t q_size = m - n + 1;
+            quot.resize(q_size);
+
+            uint32_t d = base / (static_cast<uint64_t>(den.arr[n-1]) + 1);
+
+            // u = num * d, v = den * d
+            uint32_t* u = new uint32_t[m + 1];
+            uint32_t* v = new uint32_t[n];
+            uint64_t carry = 0;
+            for (std::size_t q = 0; q < m; ++q) {
+                carry += static_cast<uint64_t>(num.arr[q]) * d;
+                u[q] = carry % base;
+                carry /= base;
+            }
+            u[m] = carry;
+            carry = 0;
+            for (std::size_t q = 0; q < n; ++q) {
+                carry += static_cast<uint64_t>(den.arr[q]) * d;
+                v[q] = carry % base;
+                carry /= base;
+            }
+
+            uint64_t v_top = v[n-1];
+            uint64_t v_next = n > 1 ? v[n-2] : 0;
+            for (std::size_t j = q_size - 1;; --j) {
+                uint64_t top = static_cast<uint64_t>(u[j+n]) * base
+                                                                + u[j+n-1];
+                uint64_t q_hat = top / v_top;
+                uint64_t r_hat = top % v_top;
+                uint64_t u_next = n > 1 ? u[j+n-2] : 0;
+                while (q_hat >= base
+                       || q_hat * v_next > r_hat * base + u_next) {
+                    --q_hat;
+                    r_hat += v_top;
+                    if (r_hat >= base) {
+                        break;
+                    }
+                }
+
+                int64_t borrow = 0;
+                carry = 0;
+                for (std::size_t q = 0; q < n; ++q) {
+                    carry += q_hat * v[q];
+                    int64_t cur = static_cast<int64_t>(u[j+q])
+                                    - static_cast<int64_t>(carry % base)
+                                    - borrow;
+                    carry /= base;
+                    borrow = cur < 0;
+                    u[j+q] = cur + (borrow ? base : 0);
+                }
+                int64_t cur = static_cast<int64_t>(u[j+n])
+                                    - static_cast<int64_t>(carry) - borrow;
+                if (cur < 0) {
+                    --q_hat;
+                    uint32_t add_carry = 0;
+                    for (std::size_t q = 0; q < n; ++q) {
+                        u[j+q] += v[q] + add_carry;
+                        if (u[j+q] >= base) {
+                            u[j+q] -= base;
+                            add_carry = 1;
+                        } else {
+                            add_carry = 0;
+                        }
+                    }
+                    cur += add_carry;
+                }
+                u[j+n] = cur;
+                quot.arr[j] = q_hat;
+
+                if (!j) {
+                    break;
+                }
+            }
+            quot.normalize();
+
+            delete [] u;
+            delete [] v;
+        }
+
+        /*
+         * ret is close to base^(2n)/v where n = v.size, the error is a few
+         *    units. Newton's iteration y = y + y*(1 - v*y/base^(2n)) on
+         *    the reciprocal of the upper half of v.
+         */
+        static void reciprocal(const BigInt& v, BigInt& ret) {
+            std::size_t n = v.size;
+            if (n <= NEWTON_DIV_THRESHOLD) {
+                BigInt power;
+                power.assign_power(2*n);
+                div_knuth(power, v, ret);
+                return;
+            }
+
+            std::size_t h = (n + 1) / 2 + 1;
+            BigInt upper, vy, corr;
+            upper.assign_top(v, h);
+            reciprocal(upper, ret);
+            ret.shift_limbs(n - h);
+
+            BigInt power;
+            power.assign_power(2*n);
+            mul(v, ret, vy);
+            if (cmp(vy, power) <= 0) {
+                power -= vy;
+                mul(ret, power, corr);
+                corr.shift_limbs(-2l * n);
+                ret += corr;
+            } else {
+                vy -= power;
+                mul(ret, vy, corr);
+                corr.shift_limbs(-2l * n);
+                corr += 1;
+                ret -= corr;
+            }
+        }
+
+        // quot = floor(num/den) through the reciprocal of den
+        static void div_newton(const BigInt& num, const BigInt& den,
+                                                            BigInt& quot) {
+            std::size_t n = den.size;
+            if (num.size < n) {
+                quot = BigInt{0};
+                return;
+            }
+
+            // The reciprocal needs as many limbs as the quotient has, so
+            //    lower limbs of den are dropped or zeros are appended
+            std::size_t prec = num.size - n + 3;
+            BigInt upper, recip, prod;
+            upper.assign_top(den, prec);
+            upper.shift_limbs(prec - upper.size);
+            reciprocal(upper, recip);
+            mul(num, recip, quot);
+            quot.shift_limbs(-static_cast<long>(n + prec));
+
+            mul(quot, den, prod);
+            BigInt one{1};
+            while (cmp(prod, num) > 0) {
+                quot -= one;
+                prod -= den;
+            }
+            BigInt rem;
+            rem.assign_top(num, num.size);
+            rem -= prod;
+            while (cmp(rem, den) >= 0) {
+                quot += 1;
+                rem -= den;
+            }
+        }
+
+        static void div(const BigInt& num, const BigInt& den, BigInt& quot) {
+            if (den.size <= NEWTON_DIV_THRESHOLD) {
+                div_knuth(num, den, quot);
+            } else {
+                div_newton(num, den, quot);
+            }
+        }
+
+        /*
+         * Writes fixed-point value of num/den into ret (most significant
+         *    limb first, ret[0] is an integer part, as in Decimal). The
+         *    integer part must fit in one limb.
+         */
+        static void div_fixed(
+            const BigInt& num,
+            const BigInt& den,
+            uint32_t* ret,
+            std::size_t ret_size
+        ) {
+            BigInt shifted, quot;
+            shifted.assign_top(num, num.size);
+            shifted.shift_limbs(ret_size - 1);
+            div(shifted, den, quot);
+            assert(quot.size <= ret_size);
+
+            for (std::size_t q = 0; q < ret_size; ++q) {
+                ret[ret_size - 1 - q] = q < quot.size ? quot.arr[q] : 0;
+            }
+        }
+
+        bool is_null() const {
+            return size == 1 && arr[0] == 0;
+        }
+
+        /*
+         * Writes exactly width characters: the number padded with leading
+         *    zeros. The digits which don't fit in width must be zeros.
+         */
+        char* to_chars(char* out, std::size_t width) const {
+            char* pos = out + width;
+            for (std::size_t q = 0; q < size && pos > out; ++q) {
+                char limb[9];
+                limb_to_chars(arr[q], limb);
+                std::size_t len = std::min<std::size_t>(9, pos - out);
+                pos -= len;
+                std::memcpy(pos, limb + 9 - len, len);
+            }
+            std::memset(out, '0', pos - out);
+            return out + width;
+        }
+
+        friend std::ostream& operator<<(std::ostream& out,
+                                                    const BigInt& num) {
+            out << num.arr[num.size - 1];
+            for (std::size_t q = num.size - 1; q > 0; --q) {
+                out << std::setw(9) << std::setfill('0') << num.arr[q-1];
+            }
+
+            return out;
+        }
+
+        uint32_t* get_arr() {
+            return arr;
+        }
+
+        std::size_t get_size() const {
+            return size;
+        }
+};
+
+// --------------------------------------------------------- binary numbers
+
+/*
+ * Division of the two-limb number by a normalized uint64_t divisor through
+ *    the precomputed reciprocal v = (2^128 - 1)/d - 2^64 (Moller and
+ *    Granlund). A divisor without the top bit is shifted left and the
+ *    dividend is shifted the same way, the quotient does not change.
+ */
+class Reciprocal2by1 {
+    int shift;
+    uint64_t divider;
+    uint64_t inv;
+
+    public:
+        explicit Reciprocal2by1(uint64_t orig_divider)
+            : shift(__builtin_clzll(orig_divider))
+            , divider(orig_divider << shift)
+            , inv(static_cast<uint64_t>(
+                ~static_cast<unsigned __int128>(0) / divider
+                                    - (static_cast<unsigned __int128>(1) << 64)
+            ))
+        {}
+
+        // Returns (rem*2^64 + limb) / divider, rem is updated, rem < divider
+        inline uint64_t divmod(uint64_t limb, uint64_t& rem) const {
+            uint64_t u1 = rem << shift;
+            uint64_t u0 = limb << shift;
+            if (shift) {
+                u1 |= limb >> (64 - shift);
+            }
+
+            unsigned __int128 p = static_cast<unsigned __int128>(inv) * u1;
+            p += (static_cast<unsigned __int128>(u1 + 1) << 64) | u0;
+            uint64_t q1 = static_cast<uint64_t>(p >> 64);
+            uint64_t q0 = static_cast<uint64_t>(p);
+            uint64_t r = u0 - q1 * divider;
+            if (r > q0) {
+                --q1;
+                r += divider;
+            }
+            if (r >= divider) {
+                ++q1;
+                r -= divider;
+            }
+
+            rem = r >> shift;
+            return q1;
+        }
+};
+
+// Little-endian radix 2^64 limbs, the result takes na + nb limbs
+static void mul_bin_school(const uint64_t* a, std::size_t na,
+                           const uint64_t* b, std::size_t nb, uint64_t* ret) {
+    std::memset(ret, 0, (na + nb) * sizeof(uint64_t));
+    for (std::size_t q = 0; q < na; ++q) {
+        uint64_t carry = 0;
+        for (std::size_t w = 0; w < nb; ++w) {
+            unsigned __int128 cur = static_cast<unsigned __int128>(a[q])
+                                                * b[w] + ret[q+w] + carry;
+            ret[q+w] = static_cast<uint64_t>(cur);
+            carry = static_cast<uint64_t>(cur >> 64);
+        }
+        ret[q + nb] = carry;
+    }
+}
+
+// The same NTT as in mul_ntt on 16-bit digits
+static void mul_bin_ntt(const uint64_t* a, std::size_t na,
+                        const uint64_t* b, std::size_t nb, uint64_t* ret) {
+    std::size_t n = 1;
+    while (n < 4 * (na + nb)) {
+        n <<= 1;
+    }
+
+    ScratchScope scratch;
+    uint64_t* fa = scratch.alloc<uint64_t>(n);
+    uint64_t* fb = scratch.alloc<uint64_t>(n);
+    for (std::size_t q = 0; q < 4*na; ++q) {
+        fa[q] = (a[q / 4] >> (16 * (q % 4))) & 0xFFFF;
+    }
+    for (std::size_t q = 0; q < 4*nb; ++q) {
+        fb[q] = (b[q / 4] >> (16 * (q % 4))) & 0xFFFF;
+    }
+    ntt::transform(fa, n, false);
+    ntt::transform(fb, n, false);
+    for (std::size_t q = 0; q < n; ++q) {
+        fa[q] = ntt::mul(fa[q], fb[q]);
+    }
+    ntt::transform(fa, n, true);
+
+    unsigned __int128 carry = 0;
+    for (std::size_t q = 0; q < na + nb; ++q) {
+        uint64_t limb = 0;
+        for (std::size_t w = 0; w < 4; ++w) {
+            carry += fa[4*q + w];
+            limb |= static_cast<uint64_t>(carry & 0xFFFF) << (16 * w);
+            carry >>= 16;
+        }
+        ret[q] = limb;
+    }
+    assert(!carry);
+}
+
+constexpr std::size_t BIN_NTT_THRESHOLD = 256;
+
+static void mul_bin(const uint64_t* a, std::size_t na,
+                    const uint64_t* b, std::size_t nb, uint64_t* ret) {
+    if (std::min(na, nb) < BIN_NTT_THRESHOLD) {
+        mul_bin_school(a, na, b, nb, ret);
+    } else {
+        mul_bin_ntt(a, na, b, nb, ret);
+    }
+}
+
+/*
+ * Converts little-endian radix 2^64 integer into BigInt. The upper half
+ *    is converted recursively and multiplied by 2^(64*h) in base 10^9,
+ *    powers[k] keeps 2^(64*2^k).
+ */
+static void bin_to_bigint(const uint64_t* a, std::size_t n, BigInt& ret,
+                                                std::vector<BigInt>& powers) {
+    constexpr std::size_t base_case = 32;
+    n = std::max<std::size_t>(n, 1);
+    while (n > 1 && a[n-1] == 0) {
+        --n;
+    }
+
+    if (n <= base_case) {
+        ret = BigInt{0};
+        for (std::size_t q = n; q > 0; --q) {
+            for (int half = 1; half >= 0; --half) {
+                ret *= 1u << 16;
+                ret *= 1u << 16;
+                ret += static_cast<uint32_t>(a[q-1] >> (32 * half));
+            }
+        }
+        return;
+    }
+
+    std::size_t k = 0;
+    while ((std::size_t{2} << k) < n) {
+        ++k;
+    }
+    std::size_t h = std::size_t{1} << k;
+    while (powers.size() <= k) {
+        if (powers.empty()) {
+            // 2^64 = 18 446744073 709551616
+            BigInt power{18};
+            power *= LIMB_BASE;
+            power += 446'744'073u;
+            power *= LIMB_BASE;
+            power += 709'551'616u;
+            powers.push_back(std::move(power));
+        } else {
+            BigInt power;
+            BigInt::mul(powers.back(), powers.back(), power);
+            powers.push_back(std::move(power));
+        }
+    }
+
+    BigInt low, high;
+    bin_to_bigint(a, h, low, powers);
+    bin_to_bigint(a + h, n - h, high, powers);
+    BigInt::mul(high, powers[k], ret);
+    ret += low;
+}
+
+/*
+ * Fixed-point number in radix 2^64 with the interface of Decimal, so
+ *    calc_part and the reductions work with both. arr[0] is an integer
+ *    part. There are no divisions by 10^9 in the carries. The limbs are
+ *    converted to decimal digits only once, in operator<<.
+ */
+class BinaryFixed {
+    std::size_t size = 0;
+    std::size_t dec_size = 0;   // size of the Decimal with the same precision
+    uint64_t *arr = nullptr;
+
+    public:
+        using Limb = uint64_t;
+
+        // digits is the size of the Decimal with the same precision
+        BinaryFixed(uint32_t a, std::size_t digits)
+            : size((digits - 1) * Decimal::get_base_len() * 3322 / 1000 / 64
+                                                                        + 2)
+            , dec_size(digits)
+            , arr(LimbPool::local().take<uint64_t>(size))
+        {
+            std::memset(arr, 0, size * sizeof(uint64_t));
+            arr[0] = a;
+        }
+
+        ~BinaryFixed() {
+            if (arr) {
+                LimbPool::local().give(arr, size);
+            }
+        }
+
+        BinaryFixed(const BinaryFixed&) = delete;
+        void operator=(const BinaryFixed&) = delete;
+
+        BinaryFixed(BinaryFixed&& other)
+            : size(other.size)
+            , dec_size(other.dec_size)
+            , arr(other.arr)
+        {
+            other.size = 0;
+            other.dec_size = 0;
+            other.arr = nullptr;
+        }
+
+        BinaryFixed& operator=(BinaryFixed&& other) {
+            std::swap(size, other.size);
+            std::swap(dec_size, other.dec_size);
+            std::swap(arr, other.arr);
+            return *this;
+        }
+
+        BinaryFixed& operator+=(const BinaryFixed& other) {
+            return add_window(other, 0);
+        }
+
+        BinaryFixed& add_window(const BinaryFixed& other, std::size_t from) {
+            assert(size == other.size);
+
+            uint64_t carry = 0;
+            std::size_t q = size;
+            while (q > from) {
+                --q;
+                uint64_t sum = arr[q] + carry;
+                carry = sum < carry;
+                arr[q] = sum + other.arr[q];
+                carry += arr[q] < sum;
+            }
+            while (carry && q > 0) {
+                --q;
+                carry = ++arr[q] == 0;
+            }
+
+            return *this;
+        }
+
+        BinaryFixed& operator+=(uint32_t other) {
+            arr[0] += other;
+            return *this;
+        }
+
+        BinaryFixed& operator*=(const BinaryFixed& other) {
+            assert(size == other.size);
+            ScratchScope scratch;
+            uint64_t* a = scratch.alloc<uint64_t>(4*size);
+            uint64_t* b = a + size;
+            uint64_t* prod = b + size;
+            for (std::size_t q = 0; q < size; ++q) {
+                a[q] = arr[size - 1 - q];
+                b[q] = other.arr[size - 1 - q];
+            }
+
+            mul_bin(a, size, b, size, prod);
+
+            for (std::size_t q = 0; q < size; ++q) {
+                arr[q] = prod[2*size - 2 - q];
+            }
+            return *this;
+        }
+
+        // The same as Decimal::add_mul_window on 2^64 limbs
+        uint64_t add_mul_window(const uint64_t* row, std::size_t len,
+                                std::size_t from, const BinaryFixed& other,
+                                std::size_t frontier) {
+            assert(from + len <= size);
+            std::size_t nb = size - from;
+            ScratchScope scratch;
+            uint64_t* a = scratch.alloc<uint64_t>(2*len + 2*nb);
+            uint64_t* b = a + len;
+            uint64_t* prod = b + nb;
+            for (std::size_t q = 0; q < len; ++q) {
+                a[q] = row[len - 1 - q];
+            }
+            for (std::size_t q = 0; q < nb; ++q) {
+                b[q] = other.arr[nb - 1 - q];
+            }
+
+            std::size_t na = len, nt = nb;
+            while (na && !a[na - 1]) {
+                --na;
+            }
+            while (nt && !b[nt - 1]) {
+                --nt;
+            }
+            if (!na || !nt) {
+                return 0;
+            }
+            mul_bin(a, na, b, nt, prod);
+            std::memset(prod + na + nt, 0,
+                                    (len + nb - na - nt) * sizeof(uint64_t));
+
+            uint64_t carry = 0;
+            std::size_t q = size;
+            std::size_t low = std::max(frontier, from ? from - 1 : 0);
+            while (q > low) {
+                --q;
+                uint64_t sum = arr[q] + carry;
+                carry = sum < carry;
+                arr[q] = sum + prod[size + len - 2 - q];
+                carry += arr[q] < sum;
+            }
+            while (carry && q > frontier) {
+                --q;
+                carry = ++arr[q] == 0;
+            }
+            if (!frontier) {
+                return 0;
+            }
+
+            uint64_t pending = carry;
+            if (frontier >= from) {
+                pending += prod[size + len - 1 - frontier];
+                check_ames(pending >= carry,
+                                    "The frozen carry overflows a limb");
+            }
+            for (std::size_t z = size + len - frontier; z < len + nb; ++z) {
+                check_ames(!prod[z], "The frozen carry overflows a limb");
+            }
+            return pending;
+        }
+
+        BinaryFixed& operator/=(uint32_t divider) {
+            int start = 0;
+            return divide__(divider, start);
+        }
+
+        BinaryFixed& divide__(uint32_t divider, int& start) {
+            Reciprocal2by1 recip{divider};
+            uint64_t reminder = 0;
+            bool is_prev_z = true;
+            for (std::size_t q = start; q < size; ++q) {
+                arr[q] = recip.divmod(arr[q], reminder);
+                if (arr[q] == 0) {
+                    if (is_prev_z) {
+                        start = q;
+                    }
+                } else {
+                    is_prev_z = false;
+                }
+            }
+
+            return *this;
+        }
+
+        /*
+         * Decimal digits of the fractional part F/2^(64m): F is converted
+         *    to base 10^9 and multiplied by 5^(64m), the result is the
+         *    digits of the fraction padded to 64m digits. Writes 64m
+         *    digits into out and returns the end of the first count.
+         */
+        char* fraction_to_chars(char* out, std::size_t count) const {
+            std::size_t m = size - 1;
+            std::vector<uint64_t> fraction(m);
+            for (std::size_t q = 0; q < m; ++q) {
+                fraction[q] = arr[size - 1 - q];
+            }
+
+            std::vector<BigInt> powers;
+            BigInt dec_fraction;
+            bin_to_bigint(fraction.data(), m, dec_fraction, powers);
+
+            // 5^(64m) by squaring
+            BigInt pow5{1}, square{5}, tmp;
+            for (std::size_t e = 64 * m; e; e >>= 1) {
+                if (e & 1) {
+                    BigInt::mul(pow5, square, tmp);
+                    pow5 = std::move(tmp);
+                }
+                if (e > 1) {
+                    BigInt::mul(square, square, tmp);
+                    square = std::move(tmp);
+                }
+            }
+            BigInt::mul(dec_fraction, pow5, tmp);
+
+            assert(count <= 64 * m);
+            tmp.to_chars(out, 64 * m);
+            return out + count;
+        }
+
+        // Upper bound of the to_chars length
+        std::size_t chars_bound() const {
+            return 21 + 64 * (size - 1);
+        }
+
+        char* to_chars(char* out) const {
+            out += std::sprintf(
+                out, "%llu.", static_cast<unsigned long long>(arr[0])
+            );
+            return fraction_to_chars(
+                out, (dec_size - 1) * Decimal::get_base_len()
+            );
+        }
+
+        friend std::ostream& operator<<(std::ostream& out,
+                                                const BinaryFixed& num) {
+            char* buf = new char[num.chars_bound()];
+            char* end = num.to_chars(buf);
+            out.write(buf, end - buf);
+            delete[] buf;
+
+            return out;
+        }
+
+        uint64_t* get_arr() {
+            return arr;
+        }
+
+        std::size_t get_size() const {
+            return size;
+        }
+
+        std::size_t get_type_size() const {
+            return sizeof(arr[0]);
+        }
+};
+
+// ------------------------------------------------------------- checkpoints
+
+// Terms between two checks of the checkpoint timer
+constexpr uint32_t CHECKPOINT_STRIDE = 1024;
+
+/*
+ * Memory-mapped binary checkpoint of the calc_part state. The file has two
+ *    slots written in turn, so the previous state is valid while the next
+ *    one is written. The sequence number of the slot is set only after
+ *    its limbs are synced, the slot with the larger number is the newest.
+ *    It is used in the threads of calc_part_threads, which don't call MPI,
+ *    so the timer is steady_clock instead of MPI_Wtime.
+ */
+class Checkpoint {
+    static constexpr uint64_t magic = 0x4550'4B43'5054'3031ull;
+
+    struct Header {
+        uint64_t magic;
+        uint64_t seq;
+        uint64_t start;
+        uint64_t end;
+        uint64_t next_k;
+        int64_t st;
+        uint64_t limbs;
+        uint64_t limb_size;
+    };
+
+    std::size_t limbs = 0;
+    std::size_t limb_size = 0;
+    std::size_t slot_size = 0;
+    std::size_t map_size = 0;
+    char* map = nullptr;
+    int fd = -1;
+
+    uint64_t seq = 0;
+    double interval = 0;
+    double last_save = 0;
+    double spent = 0;
+    int writes = 0;
+
+    Header* header(int slot) {
+        return reinterpret_cast<Header*>(map + slot * slot_size);
+    }
+
+    char* data(int slot) {
+        return map + slot * slot_size + sizeof(Header);
+    }
+
+    // Seconds of steady_clock
+    static double now() {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    public:
+        Checkpoint(const char* path, std::size_t limbs,
+                   std::size_t limb_size, double interval, bool resume)
+            : limbs(limbs)
+            , limb_size(limb_size)
+            , interval(interval)
+            , last_save(now())
+        {
+            long page = sysconf(_SC_PAGESIZE);
+            slot_size = sizeof(Header) + 2 * limbs * limb_size;
+            slot_size = (slot_size + page - 1) / page * page;
+            map_size = 2 * slot_size;
+
+            fd = open(path, O_RDWR | O_CREAT, 0644);
+            check_ames(fd >= 0, "Can not open the checkpoint file");
+            RET_IF_ERR(ftruncate(fd, map_size));
+            void* ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                                                        MAP_SHARED, fd, 0);
+            check_ames(ptr != MAP_FAILED, "Can not map the checkpoint file");
+            map = static_cast<char*>(ptr);
+
+            if (!resume) {
+                header(0)->seq = 0;
+                header(1)->seq = 0;
+            }
+        }
+
+        ~Checkpoint() {
+            munmap(map, map_size);
+            close(fd);
+        }
+
+        Checkpoint(const Checkpoint&) = delete;
+        void operator=(const Checkpoint&) = delete;
+
+        // Restores the newest slot saved for the same range and precision
+        bool load(uint32_t start, uint32_t end, void* accumulator,
+                  void* devisible, uint32_t& next_k, int& st) {
+            int best = -1;
+            for (int slot = 0; slot < 2; ++slot) {
+                Header* head = header(slot);
+                if (head->magic == magic && head->seq != 0
+                    && head->start == start && head->end == end
+                    && head->limbs == limbs && head->limb_size == limb_size
+                    && (best < 0 || head->seq > header(best)->seq)
+                ) {
+                    best = slot;
+                }
+            }
+            if (best < 0) {
+                return false;
+            }
+
+            std::size_t bytes = limbs * limb_size;
+            std::memcpy(accumulator, data(best), bytes);
+            std::memcpy(devisible, data(best) + bytes, bytes);
+            next_k = header(best)->next_k;
+            st = header(best)->st;
+            seq = header(best)->seq;
+            return true;
+        }
+
+        bool is_due() const {
+            return now() - last_save >= interval;
+        }
+
+        void save(uint32_t start, uint32_t end, const void* accumulator,
+                  const void* devisible, uint32_t next_k, int st) {
+            double save_start = now();
+            int slot = (seq + 1) % 2;
+            Header* head = header(slot);
+            std::size_t bytes = limbs * limb_size;
+
+            head->seq = 0;
+            std::memcpy(data(slot), accumulator, bytes);
+            std::memcpy(data(slot) + bytes, devisible, bytes);
+            *head = Header{
+                magic, 0, start, end, next_k, st, limbs, limb_size
+            };
+            RET_IF_ERR(msync(map + slot * slot_size, slot_size, MS_SYNC));
+            head->seq = ++seq;
+            RET_IF_ERR(msync(map + slot * slot_size, sizeof(Header),
+                                                                MS_SYNC));
+
+            last_save = now();
+            spent += last_save - save_start;
+            ++writes;
+        }
+
+        double get_spent() const {
+            return spent;
+        }
+
+        int get_writes() const {
+            return writes;
+        }
+};
+
+// ------------------------------------------------------------------ series
+
+/*
+ * The engine sums series of the form
+ *    w(0) + sum_{k=1}^{N} w(k) * r(1) * r(2) * ... * r(k)
+ *    where the ratio r(k) is a product of small factors. Every rank sums
+ *    its own range [a, b) with the devisible 1 at a, the ranges are merged
+ *    as S = S_low + D_low * S_up. A series policy has:
+ *    name - it is used in the names of files;
+ *    Scratch - temporary numbers of one summation loop;
+ *    step(dev, k, st, scratch) - dev *= r(k);
+ *    accumulate(acc, dev, k, st, scratch) - acc += w(k) * dev;
+ *    advance(acc, dev, k, end, st, scratch) - optional, step and
+ *        accumulate of one or more terms from k before end in one pass
+ *        over the limbs, returns the count of the terms;
+ *    finish(acc) - the final scaling on the rank 0;
+ *    log_ratio(k) - ln(1/r(k)), it is the cost model of partition_terms
+ *        and the count of terms.
+ */
+
+struct NoScratch {
+    explicit NoScratch(std::size_t) {}
+};
+
+// Count of terms after which the devisible is below the last limb
+template <typename Series>
+uint32_t series_terms(const Series& series, std::size_t limbs) {
+    double target = limbs * std::log(static_cast<double>(LIMB_BASE));
+    double log_prod = 0;
+    uint32_t k = 0;
+    // The zero ratio leaves only the term 0, it is the whole sum
+    if (std::isinf(series.log_ratio(1))) {
+        return 0;
+    }
+    while (log_prod <= target) {
+        log_prod += series.log_ratio(++k);
+    }
+    return k;
+}
+
+// e = 1 + sum 1/k!, it works with both Decimal and BinaryFixed
+struct ESeries {
+    using Scratch = NoScratch;
+    static constexpr const char* name = "e";
+
+    template <typename Number>
+    void step(Number& dev, uint32_t k, int& st, Scratch&) const {
+        dev.divide__(k, st);
+    }
+
+    template <typename Number>
+    void accumulate(Number& acc, const Number& dev, uint32_t,
+                                                int st, Scratch&) const {
+        acc.add_window(dev, st);
+    }
+
+    /*
+     * Four or two terms per pass while k(k+1)... fits in 32 bits. A single
+     *    term is not fused: its division is the latency chain of the pass
+     *    anyway and the vector add_window is faster than the carries here.
+     *    BinaryFixed has no fused kernel, two 2by1 divisions per limb were
+     *    not faster than two passes.
+     */
+    uint32_t advance(Decimal& acc, Decimal& dev, uint32_t k, uint32_t end,
+                                    int& st, Scratch& scratch) const {
+        uint64_t four = static_cast<uint64_t>(k) * (k+1) * (k+2) * (k+3);
+        uint32_t divs[4] = {k, 0, 0, 0};
+        if (end - k >= 4 && four <= UINT32_MAX) {
+            divs[1] = k * (k+1);
+            divs[2] = divs[1] * (k+2);
+            divs[3] = static_cast<uint32_t>(four);
+            dev.divide_accumulate__<4>(divs, acc, st);
+            return 4;
+        }
+        if (end - k >= 2 && static_cast<uint64_t>(k) * (k+1) <= UINT32_MAX) {
+            divs[1] = k * (k+1);
+            dev.divide_accumulate__<2>(divs, acc, st);
+            return 2;
+        }
+        step(dev, k, st, scratch);
+        accumulate(acc, dev, k, st, scratch);
+        return 1;
+    }
+
+    template <typename Number>
+    void finish(Number&) const {}
+
+    double log_ratio(uint32_t k) const {
+        return std::log(static_cast<double>(k));
+    }
+};
+
+// exp(u/v) = 1 + sum (u/v)^k / k!, the terms must fit in the integer part
+struct ExpSeries {
+    using Scratch = NoScratch;
+    static constexpr const char* name = "exp";
+
+    uint32_t u;
+    uint32_t v;
+
+    ExpSeries(uint32_t u, uint32_t v)
+        : u(u)
+        , v(v)
+    {
+        // The largest term e^16 / sqrt(32 pi) times u fits in a limb
+        check_ames(
+            v > 0 && u <= 64 && u <= 16 * v,
+            "exp(u/v) needs u <= 64 and u/v <= 16"
+        );
+    }
+
+    void step(Decimal& dev, uint32_t k, int& st, Scratch&) const {
+        if (u != 1) {
+            dev.multiply__(u, st);
+        }
+        uint64_t div = static_cast<uint64_t>(v) * k;
+        if (div <= UINT32_MAX) {
+            dev.divide__(div, st);
+        } else {
+            dev.divide__(v, st);
+            dev.divide__(k, st);
+        }
+    }
+
+    void accumulate(Decimal& acc, const Decimal& dev, uint32_t,
+                                                int st, Scratch&) const {
+        acc.add_window(dev, st);
+    }
+
+    void finish(Decimal&) const {}
+
+    double log_ratio(uint32_t k) const {
+        return std::log(static_cast<double>(v) * k / std::max(u, 1u));
+    }
+};
+
+/*
+ * ln 2 = 2 atanh(1/3) = 2/3 * sum 1/((2k+1) 9^k). The ratio of the terms
+ *    is (2k-1) / ((2k+1) 9), one term gives about 0.95 digits.
+ */
+struct Ln2Series {
+    using Scratch = NoScratch;
+    static constexpr const char* name = "ln2";
+
+    void step(Decimal& dev, uint32_t k, int& st, Scratch&) const {
+        dev.multiply__(2*k - 1, st);
+        dev.divide__(9 * (2*k + 1), st);
+    }
+
+    void accumulate(Decimal& acc, const Decimal& dev, uint32_t,
+                                                int st, Scratch&) const {
+        acc.add_window(dev, st);
+    }
+
+    void finish(Decimal& acc) const {
+        acc *= 2;
+        acc /= 3;
+    }
+
+    double log_ratio(uint32_t k) const {
+        return std::log(9.0 * (2*k + 1) / (2*k - 1));
+    }
+};
+
+/*
+ * sqrt(n) = n q / p * (1 - z)^(-1/2), z = (p^2 - n q^2) / p^2, where p/q
+ *    is a bit above sqrt(n). The binomial series of (1 - z)^(-1/2) has
+ *    the ratio (2k-1) z / 2k. p/q is chosen with the least z and p^2 in
+ *    32 bits, e.g. 4001/40 for 10005 gives z = 1/16008001. The root of
+ *    a perfect square is p/q itself with z = 0 and no terms.
+ */
+struct SqrtSeries {
+    using Scratch = NoScratch;
+    static constexpr const char* name = "sqrt";
+
+    uint32_t n;
+    uint32_t p = 0;
+    uint32_t q = 0;
+    uint32_t d = 0;
+
+    explicit SqrtSeries(uint32_t n)
+        : n(n)
+    {
+        check_ames(n > 0, "sqrt(n) needs positive n");
+        double best = 2;
+        for (uint64_t w = 1; w * std::sqrt(n) < 65535; ++w) {
+            uint64_t nw2 = n * w * w;
+            uint64_t v = static_cast<uint64_t>(std::sqrt(double(nw2)));
+            while (v * v > nw2) {
+                --v;
+            }
+            if (v * v == nw2) {
+                best = 0;
+                p = v;
+                q = w;
+                d = 0;
+                break;
+            }
+            ++v;
+            double z = static_cast<double>(v * v - nw2) / (v * v);
+            if (v * v - nw2 < LIMB_BASE && z < best) {
+                best = z;
+                p = v;
+                q = w;
+                d = v * v - nw2;
+            }
+        }
+        // The sum is (1 - z)^(-1/2), times n it must fit in a limb
+        check_ames(
+            p != 0 && n / std::sqrt(1 - best) < 0.99 * LIMB_BASE,
+            "sqrt(n) is too large"
+        );
+    }
+
+    void step(Decimal& dev, uint32_t k, int& st, Scratch&) const {
+        dev.multiply__(2*k - 1, st);
+        dev.divide__(2*k, st);
+        if (d != 1) {
+            dev.multiply__(d, st);
+        }
+        dev.divide__(p * p, st);
+    }
+
+    void accumulate(Decimal& acc, const Decimal& dev, uint32_t,
+                                                int st, Scratch&) const {
+        acc.add_window(dev, st);
+    }
+
+    void finish(Decimal& acc) const {
+        acc *= n;
+        acc /= p;
+        acc *= q;
+    }
+
+    double log_ratio(uint32_t k) const {
+        if (d == 0) {
+            return INFINITY;
+        }
+        return std::log(2.0 * k * p * p / ((2.0*k - 1) * d));
+    }
+};
+
+/*
+ * Chudnovsky: pi = 426880 sqrt(10005) / S, where
+ *    S = sum (-1)^k a(k) (A + B k), a(k) = (6k)! / ((3k)! (k!)^3 640320^3k).
+ *    a(k)/a(k-1) = (6k-5)(2k-1)(6k-1) / (k^3 640320^2 26680). The signs
+ *    alternate, so the term of the engine is the pair of 2k and 2k+1, it
+ *    is positive. The weight A + B k doesn't fit in the integer part of
+ *    the sum, so the sum is S / 10^9.
+ */
+struct ChudnovskySeries {
+    static constexpr const char* name = "pi";
+    static constexpr uint64_t A = 13591409;
+    static constexpr uint64_t B = 545140134;
+
+    struct Scratch {
+        Decimal next;
+        Decimal weighted;
+        Decimal high;
+
+        explicit Scratch(std::size_t prec)
+            : next(0, prec)
+            , weighted(0, prec)
+            , high(0, prec)
+        {}
+    };
+
+    // dev *= a(k)/a(k-1), factors go in turn to keep the integer part
+    static void ratio(Decimal& dev, uint32_t k, int& st) {
+        dev.multiply__(6*k - 5, st);
+        dev.divide__(k, st);
+        dev.multiply__(2*k - 1, st);
+        dev.divide__(k, st);
+        dev.multiply__(6*k - 1, st);
+        dev.divide__(k, st);
+        dev.divide__(640320, st);
+        dev.divide__(640320, st);
+        dev.divide__(26680, st);
+    }
+
+    // scratch.weighted = dev * (A + B k) / 10^9, returns its start
+    static int weight(const Decimal& dev, uint32_t k, int st,
+                                                        Scratch& scratch) {
+        uint64_t w = A + B * k;
+        int st_low = st;
+        scratch.weighted.assign_window(dev, st);
+        scratch.weighted.multiply__(w % LIMB_BASE, st_low);
+        scratch.weighted.divide__(LIMB_BASE, st_low);
+        if (w < LIMB_BASE) {
+            return st_low;
+        }
+        int st_high = st;
+        scratch.high.assign_window(dev, st);
+        scratch.high.multiply__(w / LIMB_BASE, st_high);
+        scratch.weighted.add_window(scratch.high, st_high);
+        return std::min(st_low, st_high) > 0
+                                    ? std::min(st_low, st_high) - 1 : 0;
+    }
+
+    void step(Decimal& dev, uint32_t k, int& st, Scratch&) const {
+        ratio(dev, 2*k - 1, st);
+        ratio(dev, 2*k, st);
+    }
+
+    void accumulate(Decimal& acc, const Decimal& dev, uint32_t k,
+                                        int st, Scratch& scratch) const {
+        acc.add_window(scratch.weighted, weight(dev, 2*k, st, scratch));
+
+        // The odd term is less, so acc stays positive
+        int st_next = st;
+        scratch.next.assign_window(dev, st);
+        ratio(scratch.next, 2*k + 1, st_next);
+        acc.sub_window(
+            scratch.weighted, weight(scratch.next, 2*k + 1, st_next, scratch)
+        );
+    }
+
+    void finish(Decimal&) const {}
+
+    double log_ratio(uint32_t k) const {
+        double ret = 0;
+        for (double j : {2.0*k - 1, 2.0*k}) {
+            ret += std::log(j * j * j * 640320.0 * 640320.0 * 26680.0
+                                    / ((6*j - 5) * (2*j - 1) * (6*j - 1)));
+        }
+        return ret;
+    }
+};
+
+// The fused advance of the series if it has one (the int overload wins)
+template <typename Series, typename Number>
+auto advance_terms(const Series& series, Number& acc, Number& dev,
+                   uint32_t k, uint32_t end, int& st,
+                   typename Series::Scratch& scratch, int)
+        -> decltype(series.advance(acc, dev, k, end, st, scratch)) {
+    return series.advance(acc, dev, k, end, st, scratch);
+}
+
+template <typename Series, typename Number>
+uint32_t advance_terms(const Series& series, Number& acc, Number& dev,
+                       uint32_t k, uint32_t, int& st,
+                       typename Series::Scratch& scratch, long) {
+    series.step(dev, k, st, scratch);
+    series.accumulate(acc, dev, k, st, scratch);
+    return 1;
+}
+
+/*
+ * Without the checkpoint it is the only loop over terms. With the one the
+ *    loop is split into blocks of CHECKPOINT_STRIDE terms and the timer
+ *    is checked between blocks, the state is restored first if it is
+ *    in the file.
+ */
+template <typename Series, typename Number>
+void calc_part(
+    const Series& series,
+    Number& accumulator,
+    Number& devisible,
+    uint32_t start,
+    uint32_t end,
+    std::size_t prec,
+    Checkpoint* checkpoint = nullptr
+) {
+    typename Series::Scratch scratch{prec};
+    int st = 0;
+    uint32_t q = start;
+    if (checkpoint) {
+        checkpoint->load(
+            start, end,
+            accumulator.get_arr(), devisible.get_arr(),
+            q, st
+        );
+    }
+
+    while (q < end) {
+        uint32_t block_end = end;
+        if (checkpoint) {
+            block_end = std::min<uint64_t>(end, q + CHECKPOINT_STRIDE);
+        }
+        while (q < block_end) {
+            q += advance_terms(
+                series, accumulator, devisible, q, block_end, st, scratch, 0
+            );
+        }
+        if (checkpoint && q < end && checkpoint->is_due()) {
+            checkpoint->save(
+                start, end,
+                accumulator.get_arr(), devisible.get_arr(),
+                q, st
+            );
+        }
+    }
+}
+
+/*
+ * Splits [start, end) into parts ranges with about equal work. step and
+ *    accumulate of the term k touch only limbs after the leading zeros
+ *    of the devisible r(a)*r(a+1)*...*r(k), where a is the start of the
+ *    range, so the term costs about limbs - log_base(1/(r(a)*...*r(k)))
+ *    limbs and ranges of the small terms are cheaper. The least maximal
+ *    cost of a range is found by binary search, the ranges for the cost
+ *    are built greedily. Returns parts+1 bounds, every range has at least
+ *    one term if there are enough terms.
+ */
+template <typename Series>
+std::vector<uint32_t> partition_terms(
+    const Series& series,
+    uint32_t start, uint32_t end,
+    int parts,
+    std::size_t limbs
+) {
+    // log_base(1/(r(start)*...*r(k-1))) for k in [start, end]
+    std::vector<double> log_prod(end - start + 1);
+    double log_base = std::log(static_cast<double>(LIMB_BASE));
+    log_prod[0] = 0;
+    for (uint32_t k = start; k < end; ++k) {
+        log_prod[k + 1 - start] = log_prod[k - start]
+                                        + series.log_ratio(k) / log_base;
+    }
+    // 1 is the fixed cost of the term besides its limbs
+    auto term_cost = [&](uint32_t a, uint32_t k) {
+        double used = log_prod[k + 1 - start] - log_prod[a - start];
+        return 1 + std::max(0.0, limbs - used);
+    };
+
+    std::vector<uint32_t> bounds(parts + 1);
+    // Builds the ranges with cost at most max_cost, true if they cover all
+    auto split = [&](double max_cost) {
+        uint32_t k = start;
+        for (int p = 0; p < parts; ++p) {
+            bounds[p] = k;
+            double cost = 0;
+            bool is_last = p + 1 == parts;
+            for (; k < end; ++k) {
+                // Leaves one term for every next range
+                if (!is_last && static_cast<int>(end - k) < parts - p) {
+                    break;
+                }
+                double next = cost + term_cost(bounds[p], k);
+                if (!is_last && next > max_cost && k > bounds[p]) {
+                    break;
+                }
+                cost = next;
+            }
+            if (is_last && cost > max_cost) {
+                bounds[parts] = end;
+                return false;
+            }
+        }
+        bounds[parts] = end;
+        return true;
+    };
+
+    double low = 0;
+    double high = 0;
+    for (uint32_t k = start; k < end; ++k) {
+        high += term_cost(start, k);
+    }
+    while (high - low > 1) {
+        double mid = (low + high) / 2;
+        if (split(mid)) {
+            high = mid;
+        } else {
+            low = mid;
+        }
+    }
+    split(high);
+
+    return bounds;
+}
+
+template <typename Series, typename Number>
+struct PartThreadData {
+    const Series* series;
+    Number* accumulator;
+    Number* devisible;
+    uint32_t start;
+    uint32_t end;
+    std::size_t prec;
+    Checkpoint* checkpoint;
+};
+
+template <typename Series, typename Number>
+void* calc_part_thread(void* arg) {
+    auto* data = static_cast<PartThreadData<Series, Number>*>(arg);
+    calc_part(
+        *data->series,
+        *data->accumulator, *data->devisible,
+        data->start, data->end,
+        data->prec,
+        data->checkpoint
+    );
+    return nullptr;
+}
+
+/*
+ * The same as calc_part, but [start, end) is split between threads_count
+ *    threads with their own accumulators by partition_terms. Partial
+ *    sums are merged in the order of the ranges, so accumulator and
+ *    devisible are the same as after calc_part on the whole range.
+ */
+template <typename Series, typename Number>
+void calc_part_threads(
+    const Series& series,
+    Number& accumulator,
+    Number& devisible,
+    uint32_t start,
+    uint32_t end,
+    std::size_t prec,
+    int threads_count,
+    Checkpoint** checkpoints
+) {
+    std::vector<Number*> accumulators(threads_count, &accumulator);
+    std::vector<Number*> devisibles(threads_count, &devisible);
+    std::vector<PartThreadData<Series, Number>> data(threads_count);
+    std::vector<pthread_t> threads(threads_count);
+    std::vector<uint32_t> bounds = partition_terms(
+        series, start, end, threads_count, prec
+    );
+    for (int t = 0; t < threads_count; ++t) {
+        if (t != 0) {
+            accumulators[t] = new Number{0, prec};
+            devisibles[t] = new Number{1, prec};
+        }
+        data[t] = PartThreadData<Series, Number>{
+            &series,
+            accumulators[t], devisibles[t],
+            bounds[t], bounds[t + 1],
+            prec,
+            checkpoints ? checkpoints[t] : nullptr
+        };
+    }
+
+    for (int t = 1; t < threads_count; ++t) {
+        RET_IF_ERR(
+            pthread_create(
+                &threads[t], nullptr,
+                calc_part_thread<Series, Number>, &data[t]
+            )
+        );
+    }
+    calc_part_thread<Series, Number>(&data[0]);
+    for (int t = 1; t < threads_count; ++t) {
+        RET_IF_ERR(pthread_join(threads[t], nullptr));
+    }
+
+    for (int t = threads_count - 1; t > 0; --t) {
+        *accumulators[t] *= *devisibles[t-1];
+        *accumulators[t-1] += *accumulators[t];
+        *devisibles[t-1] *= *devisibles[t];
+        delete accumulators[t];
+        delete devisibles[t];
+    }
+}
+
+/*
+ * Limbs of the numbers for prec digits after the point: the integer limb,
+ *    the partial one and a guard limb, every term and every product of
+ *    the reduction truncates the last limb.
+ */
+int prec_limbs(int prec) {
+    return prec / Decimal::get_base_len() + 3;
+}
+
+int calc_N_b_stepping(std::size_t digits) {
+    int N = 2;
+    int start = 0;
+    Decimal devisible{1, digits};
+    while (true) {
+        devisible.divide__(N, start);
+        if (devisible.is_null()) {
+            break;
+        }
+        ++N;
+    }
+    return N;
+}
+
+/*
+ * The same N as calc_N_b_stepping without the divisions. The truncated
+ *    divisions give floor(10^(9*(digits-1)) / N!), so N is the minimal
+ *    one with ln N! > 9*(digits-1)*ln 10. It is estimated by Newton's
+ *    method on Stirling's N*ln N - N and then corrected with lgamma.
+ */
+int calc_N_lgamma(std::size_t digits) {
+    double target = (digits - 1) * Decimal::get_base_len() * std::log(10.0);
+
+    double n = std::max(3.0, target / std::log(std::max(target, 3.0)));
+    for (int q = 0; q < 16; ++q) {
+        n -= (n * std::log(n) - n - target) / std::log(n);
+        n = std::max(n, 3.0);
+    }
+
+    int N = std::max(2, static_cast<int>(n));
+    while (std::lgamma(N + 1.0) <= target) {
+        ++N;
+    }
+    while (N > 2 && std::lgamma(static_cast<double>(N)) > target) {
+        --N;
+    }
+    return N;
+}
+
+template <typename Number>
+void send_decimal(Number& num, int dest, int tag) {
+    RET_IF_ERR(
+        MPI_Send(
+            num.get_arr(),
+            num.get_size() * num.get_type_size(),
+            MPI_BYTE,
+            dest,
+            tag, calc_comm
+        )
+    );
+}
+
+template <typename Number>
+void recv_decimal(Number& num, int source, int tag) {
+    RET_IF_ERR(
+        MPI_Recv(
+            num.get_arr(),
+            num.get_size() * num.get_type_size(),
+            MPI_BYTE,
+            source,
+            tag, calc_comm, MPI_STATUS_IGNORE
+        )
+    );
+}
+
+// Rank-to-rank chain, the sum goes from rank size-1 down to rank 0
+template <typename Number>
+void reduce_chain(
+    Number& accumulator,
+    Number& devisible,
+    std::size_t prec,
+    int rank, int size
+) {
+    if (rank + 1 != size) {
+        Number upper_sum{0, prec};
+        recv_decimal(upper_sum, rank + 1, UPPER_SUM_TAG);
+        upper_sum *= devisible;
+        accumulator += upper_sum;
+    }
+    if (rank != 0) {
+        send_decimal(accumulator, rank - 1, UPPER_SUM_TAG);
+    }
+}
+
+// Count of chunks of the upper sum in the pipelined chain
+constexpr int PIPE_CHUNKS = 16;
+
+/*
+ * The chain with the upper sum in chunks from the most significant one.
+ *    Every chunk is multiplied by devisible and added as soon as it has
+ *    arrived, then the same chunk of the own sum is final and goes on to
+ *    the lower rank while the next chunks are still coming. The limbs of
+ *    a sent chunk are not changed any more: the carry into them is sent
+ *    as the leading limb of the next chunk and the receiver adds it with
+ *    the chunk. So the ranks of the chain work at the same time and it
+ *    takes about one chunk per rank instead of the whole product.
+ */
+template <typename Number>
+void reduce_pipeline(
+    Number& accumulator,
+    Number& devisible,
+    int rank, int size
+) {
+    using Limb = typename Number::Limb;
+    std::size_t n = accumulator.get_size();
+    int chunks = static_cast<int>(std::min<std::size_t>(PIPE_CHUNKS, n));
+    auto bound = [n, chunks](int c) { return n * c / chunks; };
+    bool has_upper = rank + 1 != size;
+    bool has_lower = rank != 0;
+
+    // Chunk c is limbs [bound(c), bound(c+1)) after its carry limb
+    ScratchScope scratch;
+    Limb* in = scratch.alloc<Limb>(n + chunks);
+    Limb* out = scratch.alloc<Limb>(n + chunks);
+    MPI_Request* recvs = scratch.alloc<MPI_Request>(chunks);
+    MPI_Request* sends = scratch.alloc<MPI_Request>(chunks);
+
+    if (has_upper) {
+        for (int c = 0; c < chunks; ++c) {
+            RET_IF_ERR(
+                MPI_Irecv(
+                    in + bound(c) + c,
+                    (bound(c+1) - bound(c) + 1) * sizeof(Limb),
+                    MPI_BYTE,
+                    rank + 1,
+                    UPPER_SUM_TAG, calc_comm, &recvs[c]
+                )
+            );
+        }
+    }
+
+    std::size_t frontier = 0;
+    for (int c = 0; c < chunks; ++c) {
+        Limb pending = 0;
+        if (has_upper) {
+            RET_IF_ERR(MPI_Wait(&recvs[c], MPI_STATUS_IGNORE));
+            Limb* row = in + bound(c) + c;
+            std::size_t from = bound(c);
+            std::size_t len = bound(c+1) - from;
+            if (from) {
+                --from;
+                ++len;
+            } else {
+                ++row;
+            }
+            pending = accumulator.add_mul_window(
+                row, len, from, devisible, frontier
+            );
+        }
+        if (has_lower) {
+            Limb* chunk = out + bound(c) + c;
+            chunk[0] = pending;
+            std::memcpy(chunk + 1, accumulator.get_arr() + bound(c),
+                                    (bound(c+1) - bound(c)) * sizeof(Limb));
+            RET_IF_ERR(
+                MPI_Isend(
+                    chunk,
+                    (bound(c+1) - bound(c) + 1) * sizeof(Limb),
+                    MPI_BYTE,
+                    rank - 1,
+                    UPPER_SUM_TAG, calc_comm, &sends[c]
+                )
+            );
+            frontier = bound(c+1);
+        }
+    }
+    if (has_lower) {
+        RET_IF_ERR(MPI_Waitall(chunks, sends, MPI_STATUSES_IGNORE));
+    }
+}
+
+static inline bool is_tree_receiver(int rank, int size, int step) {
+    return rank % (2*step) == 0 && rank + step < size;
+}
+
+static inline bool is_tree_sender(int rank, int step) {
+    return rank % (2*step) == step;
+}
+
+/*
+ * Binary tree in log2(size) steps. On every step pairs of neighbouring
+ *    ranges are merged concurrently:
+ *        accumulator = accumulator + devisible * upper_accumulator
+ *        devisible   = devisible * upper_devisible
+ *    Rank 0 gets the whole sum.
+ */
+template <typename Number>
+void reduce_tree(
+    Number& accumulator,
+    Number& devisible,
+    std::size_t prec,
+    int rank, int size
+) {
+    for (int step = 1; step < size; step *= 2) {
+        if (is_tree_receiver(rank, size, step)) {
+            Number upper_sum{0, prec};
+            Number upper_devisible{0, prec};
+            recv_decimal(upper_sum, rank + step, UPPER_SUM_TAG);
+            recv_decimal(upper_devisible, rank + step, UPPER_DEVISIBLE_TAG);
+            upper_sum *= devisible;
+            accumulator += upper_sum;
+            if (rank != 0 || 2*step < size) {
+                devisible *= upper_devisible;
+            }
+        } else if (is_tree_sender(rank, step)) {
+            send_decimal(accumulator, rank - step, UPPER_SUM_TAG);
+            send_decimal(devisible, rank - step, UPPER_DEVISIBLE_TAG);
+            return;
+        }
+    }
+}
+
+// Reference digits of e for --verify
+const char* E_REF_PATH = "data/e_ref.txt";
+
+/*
+ * Compares the digits with the reference digits in [ref, ref_end), spaces
+ *    and line breaks between them are skipped. Only prec digits after the
+ *    point are checked, the rest is the guard of the rounding error.
+ */
+int compare_digits(const char* digits, std::size_t len, std::size_t prec,
+                                    const char* ref, const char* ref_end) {
+    const char* point = static_cast<const char*>(
+        std::memchr(digits, '.', len)
+    );
+    std::size_t point_pos = point ? point - digits : len;
+    len = std::min(len, point_pos + 1 + prec);
+
+    int ret = 0;
+    std::size_t q = 0;
+    for (; q < len; ++q, ++ref) {
+        while (ref < ref_end && (*ref == ' ' || *ref == '\n'
+                                             || *ref == '\r')) {
+            ++ref;
+        }
+        if (ref == ref_end) {
+            std::cout << "verify: the reference has only "
+                      << (q > point_pos ? q - point_pos - 1 : 0)
+                      << " digits" << std::endl;
+            ret = 1;
+            break;
+        }
+        if (*ref != digits[q]) {
+            std::cout << "verify: mismatch at digit "
+                      << (q > point_pos ? q - point_pos : 0) << ": '"
+                      << digits[q] << "' instead of '" << *ref << "'"
+                      << std::endl;
+            ret = 1;
+            break;
+        }
+    }
+    if (ret == 0) {
+        std::cout << "verify: OK, " << len - point_pos - 1
+                  << " digits" << std::endl;
+    }
+    return ret;
+}
+
+/*
+ * Compares the digits with the reference file mapped into memory. The
+ *    reference digits start after the "e =" line if it has one.
+ */
+int verify_digits(const char* digits, std::size_t len, std::size_t prec,
+                                                    const char* ref_path) {
+    int fd = open(ref_path, O_RDONLY);
+    check_ames(fd >= 0, "Can't open the reference file");
+    struct stat st;
+    check_ames(fstat(fd, &st) == 0 && st.st_size > 0,
+                                        "Can't stat the reference file");
+    std::size_t ref_len = st.st_size;
+    void* map = mmap(nullptr, ref_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    check_ames(map != MAP_FAILED, "Can't map the reference file");
+    close(fd);
+
+    const char* ref = static_cast<const char*>(map);
+    const char* ref_end = ref + ref_len;
+    const char marker[] = "e =";
+    const char* found = std::search(
+        ref, ref_end, marker, marker + sizeof(marker) - 1
+    );
+    if (found != ref_end) {
+        ref = found + sizeof(marker) - 1;
+    }
+
+    int ret = compare_digits(digits, len, prec, ref, ref_end);
+    munmap(map, ref_len);
+    return ret;
+}
+
+/*
+ * Writes the number into output/ret_<name>.txt and compares it with the
+ *    reference if verify_prec isn't zero, the reference is ref_digits or
+ *    the file of e, verify_ret gets 1 on a mismatch and 0 otherwise.
+ *    Returns the time of the conversion and the write without the
+ *    verification.
+ */
+template <typename Number>
+double write_result(const Number& num, const char* name,
+                    std::size_t verify_prec,
+                    int* verify_ret = nullptr,
+                    const std::string* ref_digits = nullptr) {
+    double write_start = MPI_Wtime();
+    char* buf = new char[num.chars_bound() + 1];
+    char* end = num.to_chars(buf);
+    *end++ = '\n';
+    char path[64];
+    std::snprintf(path, sizeof(path), "output/ret_%s.txt", name);
+    write_file(path, buf, end - buf);
+    double write_time = MPI_Wtime() - write_start;
+
+    int ret = 0;
+    if (verify_prec > 0 && ref_digits) {
+        ret = compare_digits(
+            buf, end - buf - 1, verify_prec,
+            ref_digits->data(), ref_digits->data() + ref_digits->size()
+        );
+    } else if (verify_prec > 0) {
+        ret = verify_digits(buf, end - buf - 1, verify_prec, E_REF_PATH);
+    }
+    if (verify_ret) {
+        *verify_ret = ret;
+    }
+
+    delete[] buf;
+    return write_time;
+}
+
+struct CheckpointOpts {
+    double interval = 0;   // 0 - no checkpoints
+    bool resume = false;
+};
+
+/*
+ * Distributed sum of the series, the terms [1, N] are split between ranks
+ *    by partition_terms. The sum with the term 0 and the finish of the
+ *    series is valid on the rank 0 only, as the returned time of the
+ *    slowest local sum. *reduction_time gets the slowest reduction on all
+ *    ranks if it is given.
+ */
+template <typename Series, typename Number>
+double calc_series(
+    const Series& series,
+    uint32_t N,
+    Number& accumulator,
+    std::size_t prec,
+    int rank, int size,
+    Reduction reduction,
+    int threads_count,
+    const CheckpointOpts& checkpoint_opts,
+    bool verbose = true,
+    double* reduction_time = nullptr
+) {
+    std::vector<uint32_t> bounds = partition_terms(
+        series, 1, N + 1, size, prec
+    );
+    uint32_t start = bounds[rank];
+    uint32_t end = bounds[rank + 1];
+    Number devisible{1, prec};
+
+    // Numbers of the reduction are taken from the pool and scratch of the
+    //    products from the arena, so both are filled before the summation
+    std::size_t bytes = accumulator.get_size() * accumulator.get_type_size();
+    LimbPool::local().reserve(bytes, 2);
+    scratch_arena().reserve(mul_scratch_bound(bytes));
+
+    // Every thread has its own file, see the header
+    std::vector<Checkpoint*> checkpoints;
+    if (checkpoint_opts.interval > 0 || checkpoint_opts.resume) {
+        for (int t = 0; t < threads_count; ++t) {
+            char path[64];
+            std::snprintf(path, sizeof(path),
+                "output/checkpoint_%s_%d_%d.bin", Series::name, rank, t);
+            checkpoints.push_back(new Checkpoint{
+                path,
+                accumulator.get_size(), accumulator.get_type_size(),
+                checkpoint_opts.interval > 0 ? checkpoint_opts.interval
+                                             : 1e300,
+                checkpoint_opts.resume
+            });
+        }
+    }
+
+    double part_start = MPI_Wtime();
+    if (threads_count > 1) {
+        calc_part_threads(
+            series,
+            accumulator, devisible,
+            start, end,
+            prec,
+            threads_count,
+            checkpoints.empty() ? nullptr : checkpoints.data()
+        );
+    } else {
+        calc_part(
+            series,
+            accumulator, devisible,
+            start, end,
+            prec,
+            checkpoints.empty() ? nullptr : checkpoints[0]
+        );
+    }
+    double part_time = MPI_Wtime() - part_start;
+
+    // Compute time of every rank shows the imbalance of the partition
+    std::vector<double> part_times(rank == 0 ? size : 0);
+    std::vector<uint32_t> starts(rank == 0 ? size : 0);
+    RET_IF_ERR(
+        MPI_Gather(
+            &part_time, 1, MPI_DOUBLE,
+            part_times.data(), 1, MPI_DOUBLE,
+            0, calc_comm
+        )
+    );
+    RET_IF_ERR(
+        MPI_Gather(
+            &start, 1, MPI_UINT32_T,
+            starts.data(), 1, MPI_UINT32_T,
+            0, calc_comm
+        )
+    );
+
+    double max_time = 0, sum_time = 0;
+    for (double time : part_times) {
+        max_time = std::max(max_time, time);
+        sum_time += time;
+    }
+
+    double checkpoint_time = 0;
+    int checkpoint_writes = 0;
+    for (Checkpoint* checkpoint : checkpoints) {
+        checkpoint_time += checkpoint->get_spent();
+        checkpoint_writes += checkpoint->get_writes();
+        delete checkpoint;
+    }
+
+    double reduction_start = MPI_Wtime();
+    if (reduction == RED_TREE) {
+        reduce_tree(accumulator, devisible, prec, rank, size);
+    } else if (reduction == RED_PIPE) {
+        reduce_pipeline(accumulator, devisible, rank, size);
+    } else {
+        reduce_chain(accumulator, devisible, prec, rank, size);
+    }
+    if (reduction_time) {
+        *reduction_time = MPI_Wtime() - reduction_start;
+        RET_IF_ERR(
+            MPI_Allreduce(
+                MPI_IN_PLACE, reduction_time, 1, MPI_DOUBLE,
+                MPI_MAX, calc_comm
+            )
+        );
+    }
+
+    if (rank == 0) {
+        Number one{1, prec};
+        typename Series::Scratch scratch{prec};
+        series.accumulate(accumulator, one, 0, 0, scratch);
+        series.finish(accumulator);
+    }
+
+    if (rank == 0 && verbose) {
+        std::cout << Series::name << " local sum: "
+                  << part_time * 1e9 / (end - start)
+                  << " ns per term" << std::endl;
+        for (int r = 0; r < size; ++r) {
+            std::cout << "rank " << r << ": from " << starts[r] << ", "
+                      << part_times[r] << " s" << std::endl;
+        }
+        std::cout << "imbalance (max/mean): "
+                  << max_time * size / sum_time << std::endl;
+        if (!checkpoints.empty()) {
+            std::cout << "checkpoint: " << checkpoint_writes
+                      << " writes, " << checkpoint_time << " s"
+                      << std::endl;
+        }
+    }
+    return max_time;
+}
+
+template <typename Number>
+int calc_proc(
+    uint32_t N,
+    std::size_t prec,
+    int rank, int size,
+    Reduction reduction,
+    int threads_count,
+    const CheckpointOpts& checkpoint_opts,
+    std::size_t verify_prec
+) {
+    Number accumulator{0, prec};
+    calc_series(
+        ESeries{}, N, accumulator,
+        prec, rank, size,
+        reduction, threads_count, checkpoint_opts
+    );
+
+    int verify_ret = 0;
+    if (rank == 0) {
+        double output_time = write_result(
+            accumulator, "e", verify_prec, &verify_ret
+        );
+        std::cout << "output: " << output_time << " s" << std::endl;
+    }
 
-        static uint32_t get_base() {
-            return base;
-        }
+    return verify_ret;
+}
 
-        static uint32_t get_base_len() {
-            return base_len;
-        }
-};
+/*
+ * The count of terms is found by the series itself. The sum has one more
+ *    limb, the finish of the series can scale its rounding errors.
+ */
+template <typename Series>
+void calc_constant(
+    const Series& series,
+    Decimal& result,
+    int rank, int size,
+    Reduction reduction,
+    int threads_count,
+    const CheckpointOpts& checkpoint_opts,
+    bool verbose = true
+) {
+    std::size_t prec = result.get_size() + 1;
+    Decimal sum{0, prec};
+    calc_series(
+        series, series_terms(series, prec), sum,
+        prec, rank, size,
+        reduction, threads_count, checkpoint_opts, verbose
+    );
+    std::memcpy(result.get_arr(), sum.get_arr(),
+                                    result.get_size() * sizeof(uint32_t));
+}
 
-void calc_part(
-    Decimal& accumulator,
-    Decimal& devisible,
-    uint32_t start,
-    uint32_t end,
-    std::size_t prec,
-    int rank
+/*
+ * pi = 426880 sqrt(10005) / S with both sums on all ranks and the only
+ *    long division on the rank 0. The sums have 2 more limbs for the
+ *    rounding errors of the weights and the division.
+ */
+void calc_pi(
+    Decimal& result,
+    int rank, int size,
+    Reduction reduction,
+    int threads_count,
+    const CheckpointOpts& checkpoint_opts,
+    bool verbose = true
 ) {
-    int st = 0;
-    for (uint32_t q = start; q < end; ++q) {
-        devisible.divide__(q, st);
-        accumulator += devisible;
+    std::size_t prec = result.get_size() + 2;
+    Decimal root{0, prec};
+    calc_constant(
+        SqrtSeries{10005}, root,
+        rank, size,
+        reduction, threads_count, checkpoint_opts, verbose
+    );
+    Decimal sum{0, prec};
+    calc_constant(
+        ChudnovskySeries{}, sum,
+        rank, size,
+        reduction, threads_count, checkpoint_opts, verbose
+    );
+
+    if (rank == 0) {
+        root *= 426880;
+        BigInt num, den;
+        num.assign_fixed(root.get_arr(), prec);
+        den.assign_fixed(sum.get_arr(), prec);
+        // The sum is S / 10^9
+        den.shift_limbs(1);
+        BigInt::div_fixed(num, den, result.get_arr(), result.get_size());
     }
 }
 
-int calc_N_b_stepping(std::size_t digits) {
-    int N = 2;
-    int start = 0;
-    Decimal devisible{1, digits};
-    while (true) {
-        devisible.divide__(N, start);
-        if (devisible.is_null()) {
-            break;
+/*
+ * Binary splitting. For the range [a, b) it calculates P and Q such that
+ *    sum_{k=a}^{b-1} 1/(a*(a+1)*...*k) = P/Q and Q = a*(a+1)*...*(b-1).
+ *    Two adjacent ranges are merged as P = P_l*Q_r + P_r, Q = Q_l*Q_r.
+ */
+constexpr uint32_t BS_LEAF_SIZE = 32;
+
+void bs_merge(BigInt& p_l, BigInt& q_l, const BigInt& p_r,
+                                                        const BigInt& q_r) {
+    BigInt tmp;
+    BigInt::mul(p_l, q_r, tmp);
+    tmp += p_r;
+    p_l = std::move(tmp);
+    BigInt::mul(q_l, q_r, tmp);
+    q_l = std::move(tmp);
+}
+
+void bs_calc(uint32_t a, uint32_t b, BigInt& p, BigInt& q) {
+    if (b - a <= BS_LEAF_SIZE) {
+        p = BigInt{0};
+        q = BigInt{1};
+        for (uint32_t k = a; k < b; ++k) {
+            p *= k;
+            p += 1;
+            q *= k;
         }
-        ++N;
+        return;
     }
-    return N;
+
+    uint32_t mid = a + (b - a) / 2;
+    BigInt p_r, q_r;
+    bs_calc(a, mid, p, q);
+    bs_calc(mid, b, p_r, q_r);
+    bs_merge(p, q, p_r, q_r);
 }
 
-int calc_proc(
+void send_bigint(BigInt& num, int dest, int tag) {
+    RET_IF_ERR(
+        MPI_Send(
+            num.get_arr(),
+            num.get_size(),
+            MPI_UINT32_T,
+            dest,
+            tag, calc_comm
+        )
+    );
+}
+
+void recv_bigint(BigInt& num, int source, int tag) {
+    MPI_Status status;
+    int count = 0;
+    RET_IF_ERR(MPI_Probe(source, tag, calc_comm, &status));
+    RET_IF_ERR(MPI_Get_count(&status, MPI_UINT32_T, &count));
+    num.resize(count);
+    RET_IF_ERR(
+        MPI_Recv(
+            num.get_arr(),
+            count,
+            MPI_UINT32_T,
+            source,
+            tag, calc_comm, MPI_STATUS_IGNORE
+        )
+    );
+}
+
+int calc_proc_bs(
     uint32_t start, uint32_t end,
     std::size_t prec,
-    int rank, int size
+    int rank, int size,
+    Reduction reduction,
+    std::size_t verify_prec
 ) {
-    Decimal accumulator{0, prec};
-    Decimal devisible{1, prec};
-    calc_part(accumulator, devisible, start, end, prec, rank);
-    Decimal upper_sum{0, prec};
-    std::size_t dec_size = devisible.get_size() *
-                                                devisible.get_type_size();
-    
-    if (rank + 1 != size) {
-        RET_IF_ERR(
-            MPI_Recv(
-                upper_sum.get_arr(),
-                dec_size,
-                MPI_BYTE,
-                rank + 1,
-                UPPER_SUM_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE
-            )
-        );
-        upper_sum *= devisible;
-        accumulator += upper_sum;
-    }
-    if (rank != 0) {
-        RET_IF_ERR(
-            MPI_Send(
-                accumulator.get_arr(),
-                dec_size,
-                MPI_BYTE,
-                rank - 1,
-                UPPER_SUM_TAG, MPI_COMM_WORLD
-            )
-        );
+    BigInt p, q;
+    bs_calc(start, end, p, q);
+
+    if (reduction == RED_TREE) {
+        for (int step = 1; step < size; step *= 2) {
+            if (is_tree_receiver(rank, size, step)) {
+                BigInt upper_p, upper_q;
+                recv_bigint(upper_p, rank + step, BS_P_TAG);
+                recv_bigint(upper_q, rank + step, BS_Q_TAG);
+                bs_merge(p, q, upper_p, upper_q);
+            } else if (is_tree_sender(rank, step)) {
+                send_bigint(p, rank - step, BS_P_TAG);
+                send_bigint(q, rank - step, BS_Q_TAG);
+                break;
+            }
+        }
     } else {
+        if (rank + 1 != size) {
+            BigInt upper_p, upper_q;
+            recv_bigint(upper_p, rank + 1, BS_P_TAG);
+            recv_bigint(upper_q, rank + 1, BS_Q_TAG);
+            bs_merge(p, q, upper_p, upper_q);
+        }
+        if (rank != 0) {
+            send_bigint(p, rank - 1, BS_P_TAG);
+            send_bigint(q, rank - 1, BS_Q_TAG);
+        }
+    }
+
+    int verify_ret = 0;
+    if (rank == 0) {
+        Decimal accumulator{0, prec};
+        BigInt::div_fixed(p, q, accumulator.get_arr(), prec);
         accumulator += 1;
-        std::ofstream output("output/ret_e.txt");
-        output << accumulator << std::endl;
+        write_result(accumulator, "e", verify_prec, &verify_ret);
     }
 
-    return 0;
+    return verify_ret;
 }
 
 void test_decimal() {
@@ -333,6 +3748,25 @@ void test_mil_long_long() {
     return;
 }
 
+void test_bigint_div() {
+    BigInt p{1};
+    BigInt q{3};
+    Decimal dec{0, 3};
+    BigInt::div_fixed(p, q, dec.get_arr(), dec.get_size());
+    std::cout << dec << "[0.333333333333333333]" << std::endl;
+
+    BigInt big_p, big_q;
+    bs_calc(1, 40, big_p, big_q);
+    std::cout << big_p << " / " << big_q << std::endl;
+    Decimal e{0, 5};
+    BigInt::div_fixed(big_p, big_q, e.get_arr(), e.get_size());
+    e += 1;
+    std::cout << e << "[2.718281828459045235360287471352662497]"
+                                                            << std::endl;
+
+    return;
+}
+
 void test_mul_again() {
     for (uint64_t q = 0; q < 1'000'000'000; ++q) {
         if (q % 100'000'000) {
@@ -352,11 +3786,297 @@ void test_mul_again() {
 
 }
 
+// ------------------------------------------------------------ benchmarks
+
+// Runs func until at least min_time seconds pass, returns us per call
+template <typename Func>
+double bench_time_us(Func&& func, double min_time = 0.05) {
+    using clock = std::chrono::steady_clock;
+    std::size_t reps = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed{0};
+    do {
+        func();
+        ++reps;
+        elapsed = clock::now() - start;
+    } while (elapsed.count() < min_time);
+
+    return elapsed.count() * 1e6 / reps;
+}
+
+void bench_mul() {
+    const char* names[] = {"legacy", "school", "karatsuba", "toom3", "ntt"};
+    const MulTier tiers[] = {MUL_SCHOOL, MUL_KARATSUBA, MUL_TOOM3, MUL_NTT};
+    constexpr int tiers_count = sizeof(tiers) / sizeof(tiers[0]);
+    constexpr std::size_t legacy_max = 8192;
+    constexpr std::size_t school_max = 16384;
+    constexpr std::size_t max_limbs = 65536;
+
+    srand(7);
+    std::cout << "us per multiplication of two n-limb numbers" << std::endl;
+    std::cout << std::setw(8) << "limbs";
+    for (const char* name : names) {
+        std::cout << std::setw(12) << name;
+    }
+    std::cout << std::endl;
+
+    std::size_t crossover[tiers_count] = {0};
+    for (std::size_t n = 16; n <= max_limbs; n *= 2) {
+        std::vector<uint32_t> a(n), b(n), ref(2*n), ret(2*n);
+        for (std::size_t q = 0; q < n; ++q) {
+            a[q] = rand() % LIMB_BASE;
+            b[q] = rand() % LIMB_BASE;
+        }
+
+        std::cout << std::setw(8) << n << std::fixed << std::setprecision(1);
+        if (n <= legacy_max) {
+            Decimal dec_a{0, n};
+            Decimal dec_b{0, n};
+            std::memcpy(dec_a.get_arr(), a.data(), n * sizeof(uint32_t));
+            std::memcpy(dec_b.get_arr(), b.data(), n * sizeof(uint32_t));
+            std::cout << std::setw(12)
+                      << bench_time_us([&]() { dec_a.mul_legacy(dec_b); });
+        } else {
+            std::cout << std::setw(12) << "-";
+        }
+
+        double prev_time = 0;
+        mul_limbs_tier(MUL_NTT, a.data(), n, b.data(), n, ref.data());
+        for (int t = 0; t < tiers_count; ++t) {
+            if (tiers[t] == MUL_SCHOOL && n > school_max) {
+                std::cout << std::setw(12) << "-";
+                continue;
+            }
+            double time = bench_time_us([&]() {
+                mul_limbs_tier(tiers[t], a.data(), n, b.data(), n,
+                                                                ret.data());
+            });
+            check_ames(ret == ref, "Multiplication tiers disagree");
+            if (t > 0 && !crossover[t] && prev_time != 0
+                                                    && time < prev_time) {
+                crossover[t] = n;
+            }
+            prev_time = time;
+            std::cout << std::setw(12) << time;
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "first size where the tier beats the previous one:"
+                                                            << std::endl;
+    for (int t = 1; t < tiers_count; ++t) {
+        std::cout << "    " << names[t+1] << ": ";
+        if (crossover[t]) {
+            std::cout << crossover[t];
+        } else {
+            std::cout << "-";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void bench_div() {
+    constexpr std::size_t sizes[] = {1'000, 100'000, 10'000'000};
+    srand(7);
+    std::cout << "ns per limb of the division by a small divisor"
+                                                            << std::endl;
+    std::cout << std::setw(10) << "limbs" << std::setw(12) << "hardware"
+              << std::setw(12) << "reciprocal" << std::setw(12) << "speedup"
+              << std::endl;
+
+    for (std::size_t n : sizes) {
+        Decimal hw{0, n};
+        Decimal rc{0, n};
+        for (std::size_t q = 0; q < n; ++q) {
+            hw.get_arr()[q] = rc.get_arr()[q] = rand() % LIMB_BASE;
+        }
+
+        // The divisors are the same as in calc_part for large k
+        uint32_t divider = 1'000'003;
+        auto run = [&](Decimal& dec, bool use_hw) {
+            int start = 0;
+            if (use_hw) {
+                dec.divide_hw__(divider, start);
+            } else {
+                dec.divide__(divider, start);
+            }
+            ++divider;
+            // Keeps the values away from zero
+            dec.get_arr()[0] = LIMB_BASE - 1;
+        };
+        double time_hw = bench_time_us([&]() { run(hw, true); });
+        divider = 1'000'003;
+        double time_rc = bench_time_us([&]() { run(rc, false); });
+
+        std::cout << std::setw(10) << n << std::fixed << std::setprecision(3)
+                  << std::setw(12) << time_hw * 1e3 / n
+                  << std::setw(12) << time_rc * 1e3 / n
+                  << std::setw(12) << time_hw / time_rc << std::endl;
+    }
+
+    // Correctness against the hardware division
+    for (uint32_t divider : {1u, 2u, 3u, 7u, 1'000'000'007u, 4'294'967'295u}) {
+        Decimal hw{0, 1000};
+        Decimal rc{0, 1000};
+        for (std::size_t q = 0; q < 1000; ++q) {
+            hw.get_arr()[q] = rc.get_arr()[q] = rand() % LIMB_BASE;
+        }
+        int start_hw = 0, start_rc = 0;
+        hw.divide_hw__(divider, start_hw);
+        rc.divide__(divider, start_rc);
+        check_ames(
+            std::memcmp(hw.get_arr(), rc.get_arr(), 1000 * 4) == 0
+                                                && start_hw == start_rc,
+            "Division kernels disagree"
+        );
+    }
+}
+
+void bench_add() {
+    const char* names[] = {"scalar", "avx2", "avx512"};
+    const AddKernel kernels[] = {ADD_SCALAR, ADD_AVX2, ADD_AVX512};
+    constexpr std::size_t sizes[] = {100, 10'000, 1'000'000};
+
+    srand(7);
+    std::cout << "10^9 limbs per second of a += b" << std::endl;
+    std::cout << std::setw(10) << "limbs";
+    for (const char* name : names) {
+        std::cout << std::setw(12) << name;
+    }
+    std::cout << std::endl;
+
+    for (std::size_t n : sizes) {
+        // Every fourth pair sums to base - 1 and passes the carry on
+        std::vector<uint32_t> a(n), b(n);
+        for (std::size_t q = 0; q < n; ++q) {
+            a[q] = rand() % LIMB_BASE;
+            b[q] = rand() % 4 ? rand() % LIMB_BASE : LIMB_BASE - 1 - a[q];
+        }
+        std::vector<uint32_t> ref = a;
+        uint32_t ref_carry = add_dec_scalar(ref.data(), b.data(), n);
+
+        std::cout << std::setw(10) << n << std::fixed << std::setprecision(2);
+        for (AddKernel kernel : kernels) {
+            if (!add_kernel_supported(kernel)) {
+                std::cout << std::setw(12) << "-";
+                continue;
+            }
+            std::vector<uint32_t> ret = a;
+            uint32_t carry = add_dec_kernel(kernel, ret.data(), b.data(), n);
+            check_ames(ret == ref && carry == ref_carry,
+                                            "Addition kernels disagree");
+
+            // The sum runs away from the base, the values are not checked
+            double time = bench_time_us([&]() {
+                add_dec_kernel(kernel, ret.data(), b.data(), n);
+            });
+            std::cout << std::setw(12) << n / time * 1e-3;
+        }
+        std::cout << std::endl;
+    }
+}
+
+void bench_n() {
+    constexpr int precs[] = {10, 100, 1'000, 10'000, 100'000, 1'000'000};
+    std::cout << "count of terms, stepping against lgamma estimation"
+                                                            << std::endl;
+    std::cout << std::setw(10) << "digits" << std::setw(10) << "N step"
+              << std::setw(10) << "N lgamma" << std::setw(14) << "step s"
+              << std::setw(14) << "lgamma us" << std::endl;
+
+    for (int prec : precs) {
+        std::size_t digits = prec / Decimal::get_base_len() + 2;
+
+        double step_start = MPI_Wtime();
+        int n_step = calc_N_b_stepping(digits);
+        double step_time = MPI_Wtime() - step_start;
+
+        int n_lgamma = 0;
+        double lgamma_time = bench_time_us([&]() {
+            n_lgamma = calc_N_lgamma(digits);
+        });
+
+        std::cout << std::setw(10) << prec << std::setw(10) << n_step
+                  << std::setw(10) << n_lgamma << std::fixed
+                  << std::setprecision(3) << std::setw(14) << step_time
+                  << std::setw(14) << lgamma_time << std::endl;
+        check_ames(n_step == n_lgamma, "Estimation of N is wrong");
+    }
+}
+
+/*
+ * Time of every constant on all ranks at 10^4, 10^5 and 10^6 digits, the
+ *    sizes above max_prec are skipped.
+ */
+void bench_series(int max_prec, int rank, int size) {
+    constexpr int precs[] = {10'000, 100'000, 1'000'000};
+    const char* names[] = {"e", "pi", "ln2", "sqrt(2)", "exp(1/2)"};
+    constexpr int names_count = sizeof(names) / sizeof(names[0]);
+    CheckpointOpts no_checkpoint;
+    if (rank == 0) {
+        std::cout << "seconds of the series on " << size << " ranks"
+                                                            << std::endl;
+        std::cout << std::setw(10) << "constant" << std::setw(10) << "digits"
+                  << std::setw(12) << "time" << std::endl;
+    }
+
+    for (int prec : precs) {
+        if (prec > max_prec) {
+            continue;
+        }
+        std::size_t digits = prec_limbs(prec);
+        for (int c = 0; c < names_count; ++c) {
+            Decimal result{0, digits};
+            RET_IF_ERR(MPI_Barrier(MPI_COMM_WORLD));
+            double start = MPI_Wtime();
+            switch (c) {
+                case 0:
+                    calc_series(
+                        ESeries{}, calc_N_lgamma(digits), result,
+                        digits, rank, size,
+                        RED_CHAIN, 1, no_checkpoint, false
+                    );
+                    break;
+                case 1:
+                    calc_pi(
+                        result, rank, size,
+                        RED_CHAIN, 1, no_checkpoint, false
+                    );
+                    break;
+                case 2:
+                    calc_constant(
+                        Ln2Series{}, result, rank, size,
+                        RED_CHAIN, 1, no_checkpoint, false
+                    );
+                    break;
+                case 3:
+                    calc_constant(
+                        SqrtSeries{2}, result, rank, size,
+                        RED_CHAIN, 1, no_checkpoint, false
+                    );
+                    break;
+                case 4:
+                    calc_constant(
+                        ExpSeries{1, 2}, result, rank, size,
+                        RED_CHAIN, 1, no_checkpoint, false
+                    );
+                    break;
+            }
+            RET_IF_ERR(MPI_Barrier(MPI_COMM_WORLD));
+            double time = MPI_Wtime() - start;
+
+            if (rank == 0) {
+                std::cout << std::setw(10) << names[c] << std::setw(10)
+                          << prec << std::fixed << std::setprecision(3)
+                          << std::setw(12) << time << std::endl;
+            }
+        }
+    }
+}
+
 int calc_N(int rank, int digits, int argc, char** argv) {
     int N = 0;
-    if (argc >= 3 && std::strcmp(argv[2], "apr")) {
-        N = 3*digits + 1;
-    } else {
+    if (argc >= 3 && !std::strcmp(argv[2], "step")) {
         if (rank == 0) {
             N = calc_N_b_stepping(digits);
         }
@@ -367,13 +4087,385 @@ int calc_N(int rank, int digits, int argc, char** argv) {
                 0, MPI_COMM_WORLD
             )
         );
+    } else {
+        // Every rank gets the same N, there is no need to broadcast it
+        N = calc_N_lgamma(digits);
     }
 
     return N;
 }
 
+enum Algorithm {
+    ALG_DIV,
+    ALG_BS,
+};
+
+enum Radix {
+    RADIX_DEC,
+    RADIX_BIN,
+};
+
+enum Bench {
+    BENCH_NONE,
+    BENCH_MUL,
+    BENCH_DIV,
+    BENCH_ADD,
+    BENCH_N,
+    BENCH_SERIES,
+    BENCH_SCALE,
+};
+
+enum Format {
+    FORMAT_CSV,
+    FORMAT_JSON,
+};
+
+enum Constant {
+    CONST_E,
+    CONST_PI,
+    CONST_LN2,
+    CONST_SQRT,
+    CONST_EXP,
+};
+
+struct Options {
+    Constant constant = CONST_E;
+    uint32_t const_u = 0;   // n of sqrt, numerator of exp
+    uint32_t const_v = 1;   // denominator of exp
+    Algorithm alg = ALG_DIV;
+    Reduction reduction = RED_CHAIN;
+    Radix radix = RADIX_DEC;
+    int threads = 1;
+    CheckpointOpts checkpoint;
+    Bench bench = BENCH_NONE;
+    Format format = FORMAT_CSV;
+    bool verify = false;
+};
+
+Options parse_options(int argc, char** argv) {
+    Options opts;
+    for (int q = 3; q < argc; ++q) {
+        if (!std::strcmp(argv[q], "--const") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "e")) {
+                opts.constant = CONST_E;
+            } else if (!std::strcmp(argv[q], "pi")) {
+                opts.constant = CONST_PI;
+            } else if (!std::strcmp(argv[q], "ln2")) {
+                opts.constant = CONST_LN2;
+            } else if (std::sscanf(argv[q], "sqrt:%u", &opts.const_u) == 1) {
+                opts.constant = CONST_SQRT;
+            } else if (std::sscanf(argv[q], "exp:%u/%u",
+                                    &opts.const_u, &opts.const_v) == 2) {
+                opts.constant = CONST_EXP;
+            } else {
+                check_ames(0, "Unknown constant");
+            }
+        } else if (!std::strcmp(argv[q], "--alg") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "div")) {
+                opts.alg = ALG_DIV;
+            } else if (!std::strcmp(argv[q], "bs")) {
+                opts.alg = ALG_BS;
+            } else {
+                check_ames(0, "Unknown algorithm, use div or bs");
+            }
+        } else if (!std::strcmp(argv[q], "--reduce") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "chain")) {
+                opts.reduction = RED_CHAIN;
+            } else if (!std::strcmp(argv[q], "tree")) {
+                opts.reduction = RED_TREE;
+            } else if (!std::strcmp(argv[q], "pipe")) {
+                opts.reduction = RED_PIPE;
+            } else {
+                check_ames(0, "Unknown reduction, use chain, tree or pipe");
+            }
+        } else if (!std::strcmp(argv[q], "--radix") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "dec")) {
+                opts.radix = RADIX_DEC;
+            } else if (!std::strcmp(argv[q], "bin")) {
+                opts.radix = RADIX_BIN;
+            } else {
+                check_ames(0, "Unknown radix, use dec or bin");
+            }
+        } else if (!std::strcmp(argv[q], "--threads") && q + 1 < argc) {
+            opts.threads = atoi(argv[++q]);
+            check_ames(opts.threads > 0, "Threads count must be positive");
+        } else if (!std::strcmp(argv[q], "--checkpoint") && q + 1 < argc) {
+            opts.checkpoint.interval = atof(argv[++q]);
+            check_ames(
+                opts.checkpoint.interval > 0,
+                "Checkpoint interval must be positive"
+            );
+        } else if (!std::strcmp(argv[q], "--resume")) {
+            opts.checkpoint.resume = true;
+        } else if (!std::strcmp(argv[q], "--verify")) {
+            opts.verify = true;
+        } else if (!std::strcmp(argv[q], "--bench") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "mul")) {
+                opts.bench = BENCH_MUL;
+            } else if (!std::strcmp(argv[q], "div")) {
+                opts.bench = BENCH_DIV;
+            } else if (!std::strcmp(argv[q], "add")) {
+                opts.bench = BENCH_ADD;
+            } else if (!std::strcmp(argv[q], "n")) {
+                opts.bench = BENCH_N;
+            } else if (!std::strcmp(argv[q], "series")) {
+                opts.bench = BENCH_SERIES;
+            } else if (!std::strcmp(argv[q], "scale")) {
+                opts.bench = BENCH_SCALE;
+            } else {
+                check_ames(0, "Unknown benchmark");
+            }
+        } else if (!std::strcmp(argv[q], "--format") && q + 1 < argc) {
+            ++q;
+            if (!std::strcmp(argv[q], "csv")) {
+                opts.format = FORMAT_CSV;
+            } else if (!std::strcmp(argv[q], "json")) {
+                opts.format = FORMAT_JSON;
+            } else {
+                check_ames(0, "Unknown format, use csv or json");
+            }
+        } else {
+            check_ames(0, "Unknown option");
+        }
+    }
+
+    check_ames(
+        opts.alg != ALG_BS || opts.radix == RADIX_DEC,
+        "Binary splitting works only with the decimal radix"
+    );
+    check_ames(
+        opts.bench != BENCH_SCALE || opts.alg == ALG_DIV,
+        "The scale benchmark runs only the div algorithm"
+    );
+    check_ames(
+        opts.alg != ALG_BS || opts.threads == 1,
+        "Binary splitting works only with one thread"
+    );
+    check_ames(
+        opts.alg != ALG_BS
+            || (opts.checkpoint.interval == 0 && !opts.checkpoint.resume),
+        "Binary splitting has no checkpoints"
+    );
+    check_ames(
+        opts.constant == CONST_E
+            || (opts.alg == ALG_DIV && opts.radix == RADIX_DEC),
+        "Constants except e work only with div and the decimal radix"
+    );
+    check_ames(
+        opts.constant == CONST_E || !opts.verify
+            || (opts.constant == CONST_SQRT
+                    && SqrtSeries{opts.const_u}.d == 0),
+        "There is the reference only for e and sqrt of perfect squares"
+    );
+
+    return opts;
+}
+
+int calc_proc_const(const Options& opts, std::size_t prec,
+                            int rank, int size, std::size_t verify_prec) {
+    Decimal result{0, prec};
+    const char* name = nullptr;
+    switch (opts.constant) {
+        case CONST_PI:
+            name = ChudnovskySeries::name;
+            calc_pi(
+                result, rank, size,
+                opts.reduction, opts.threads, opts.checkpoint
+            );
+            break;
+        case CONST_LN2:
+            name = Ln2Series::name;
+            calc_constant(
+                Ln2Series{}, result, rank, size,
+                opts.reduction, opts.threads, opts.checkpoint
+            );
+            break;
+        case CONST_SQRT:
+            name = SqrtSeries::name;
+            calc_constant(
+                SqrtSeries{opts.const_u}, result, rank, size,
+                opts.reduction, opts.threads, opts.checkpoint
+            );
+            break;
+        case CONST_EXP:
+            name = ExpSeries::name;
+            calc_constant(
+                ExpSeries{opts.const_u, opts.const_v}, result, rank, size,
+                opts.reduction, opts.threads, opts.checkpoint
+            );
+            break;
+        default:
+            check_ames(0, "e is calculated by calc_proc");
+    }
+
+    // The root of a perfect square is exact, it is its own reference
+    std::string ref_digits;
+    if (opts.constant == CONST_SQRT && verify_prec > 0) {
+        SqrtSeries series{opts.const_u};
+        ref_digits = std::to_string(series.p / series.q) + "."
+                                        + std::string(verify_prec, '0');
+    }
+
+    int verify_ret = 0;
+    if (rank == 0) {
+        double output_time = write_result(
+            result, name, verify_prec, &verify_ret,
+            ref_digits.empty() ? nullptr : &ref_digits
+        );
+        std::cout << "output: " << output_time << " s" << std::endl;
+    }
+
+    return verify_ret;
+}
+
+// Wall times of one run of bench_scale on the rank 0, in seconds
+struct ScaleRow {
+    const char* kind;
+    int ranks;
+    int prec;
+    uint32_t terms;
+    double n_estimate;
+    double local_sum;
+    double reduction;
+    double output;
+};
+
+/*
+ * The sum starts on all ranks together. The reduction is the slowest
+ *    reduce call of all ranks, the waiting for the local sums before it
+ *    is not counted.
+ */
+template <typename Number>
+ScaleRow scale_run(const Options& opts, const char* kind, int prec,
+                                                    int rank, int size) {
+    ScaleRow row{kind, size, prec, 0, 0, 0, 0, 0};
+    std::size_t digits = prec_limbs(prec);
+
+    double n_start = MPI_Wtime();
+    row.terms = calc_N_lgamma(digits);
+    row.n_estimate = MPI_Wtime() - n_start;
+
+    Number accumulator{0, digits};
+    RET_IF_ERR(MPI_Barrier(calc_comm));
+    row.local_sum = calc_series(
+        ESeries{}, row.terms, accumulator,
+        digits, rank, size,
+        opts.reduction, opts.threads, CheckpointOpts{}, false,
+        &row.reduction
+    );
+
+    if (rank == 0) {
+        row.output = write_result(accumulator, "scale", 0);
+    }
+    return row;
+}
+
+void print_scale_row(const ScaleRow& row, const Options& opts, bool first) {
+    const char* radixes[] = {"dec", "bin"};
+    const char* reductions[] = {"chain", "tree", "pipe"};
+    double total = row.n_estimate + row.local_sum + row.reduction
+                                                            + row.output;
+    if (opts.format == FORMAT_CSV) {
+        std::printf("%s,%d,%d,%s,%s,%d,%u,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+                    row.kind, row.ranks, opts.threads,
+                    radixes[opts.radix], reductions[opts.reduction],
+                    row.prec, row.terms, row.n_estimate, row.local_sum,
+                    row.reduction, row.output, total);
+    } else {
+        std::printf("%s  {\"kind\": \"%s\", \"ranks\": %d, "
+                    "\"threads\": %d, \"radix\": \"%s\", "
+                    "\"reduction\": \"%s\", \"digits\": %d, "
+                    "\"terms\": %u, \"n_estimate_s\": %.6f, "
+                    "\"local_sum_s\": %.6f, \"reduction_s\": %.6f, "
+                    "\"output_s\": %.6f, \"total_s\": %.6f}",
+                    first ? "" : ",\n",
+                    row.kind, row.ranks, opts.threads,
+                    radixes[opts.radix], reductions[opts.reduction],
+                    row.prec, row.terms, row.n_estimate, row.local_sum,
+                    row.reduction, row.output, total);
+    }
+    std::fflush(stdout);
+}
+
+/*
+ * Scaling of e on the first r ranks for r = 1, 2, 4, ... and size. The
+ *    strong rows keep max_prec / 100, max_prec / 10 and max_prec digits
+ *    for every r, the weak rows have max_prec * r / size digits. The
+ *    other ranks wait, the options choose the radix, the reduction and
+ *    the threads.
+ */
+void bench_scale(const Options& opts, int max_prec, int rank, int size) {
+    std::vector<int> rank_counts;
+    for (int r = 1; r < size; r *= 2) {
+        rank_counts.push_back(r);
+    }
+    rank_counts.push_back(size);
+
+    if (rank == 0) {
+        if (opts.format == FORMAT_CSV) {
+            std::printf("kind,ranks,threads,radix,reduction,digits,terms,"
+                        "n_estimate_s,local_sum_s,reduction_s,output_s,"
+                        "total_s\n");
+        } else {
+            std::printf("[\n");
+        }
+    }
+
+    bool first = true;
+    for (int ranks : rank_counts) {
+        MPI_Comm comm;
+        RET_IF_ERR(
+            MPI_Comm_split(
+                MPI_COMM_WORLD, rank < ranks ? 0 : MPI_UNDEFINED, rank, &comm
+            )
+        );
+        if (comm != MPI_COMM_NULL) {
+            calc_comm = comm;
+            std::vector<std::pair<const char*, int>> runs;
+            for (int prec : {max_prec / 100, max_prec / 10, max_prec}) {
+                if (prec >= 10) {
+                    runs.push_back({"strong", prec});
+                }
+            }
+            runs.push_back({"weak", std::max(10, max_prec / size * ranks)});
+
+            for (const auto& run : runs) {
+                ScaleRow row = opts.radix == RADIX_BIN
+                    ? scale_run<BinaryFixed>(
+                        opts, run.first, run.second, rank, ranks)
+                    : scale_run<Decimal>(
+                        opts, run.first, run.second, rank, ranks);
+                if (rank == 0) {
+                    print_scale_row(row, opts, first);
+                }
+                first = false;
+            }
+            calc_comm = MPI_COMM_WORLD;
+            RET_IF_ERR(MPI_Comm_free(&comm));
+        }
+        RET_IF_ERR(MPI_Barrier(MPI_COMM_WORLD));
+    }
+
+    if (rank == 0 && opts.format == FORMAT_JSON) {
+        std::printf("\n]\n");
+    }
+}
+
 int main(int argc, char** argv) {
-    RET_IF_ERR(MPI_Init(&argc, &argv));
+    // Only the main thread calls MPI, see calc_part_threads
+    int provided = 0;
+    RET_IF_ERR(
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided)
+    );
+    check_ames(
+        provided >= MPI_THREAD_FUNNELED,
+        "MPI does not support threads"
+    );
 
     check_ames(
         argc > 2,
@@ -384,27 +4476,70 @@ int main(int argc, char** argv) {
     RET_IF_ERR(MPI_Comm_size(MPI_COMM_WORLD, &size));
     RET_IF_ERR(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
 
+    Options opts = parse_options(argc, argv);
+    if (opts.bench == BENCH_SERIES) {
+        bench_series(atoi(argv[1]), rank, size);
+        RET_IF_ERR(MPI_Finalize());
+        return 0;
+    }
+    if (opts.bench == BENCH_SCALE) {
+        bench_scale(opts, atoi(argv[1]), rank, size);
+        RET_IF_ERR(MPI_Finalize());
+        return 0;
+    }
+    if (opts.bench != BENCH_NONE) {
+        if (rank == 0) {
+            switch (opts.bench) {
+                case BENCH_MUL: bench_mul(); break;
+                case BENCH_DIV: bench_div(); break;
+                case BENCH_ADD: bench_add(); break;
+                case BENCH_N: bench_n(); break;
+                default: break;
+            }
+        }
+        RET_IF_ERR(MPI_Finalize());
+        return 0;
+    }
+
     int prec = atoi(argv[1]);
-    int digits = prec / Decimal::get_base_len() + 2;
+    int digits = prec_limbs(prec);
 
-    int N = calc_N(rank, digits, argc, argv);
-    
-    clock_t start, end;
-    if (rank == 0) {
-        start = clock();
-    }
+    // The other constants find the count of terms by their series
+    int N = opts.constant == CONST_E ? calc_N(rank, digits, argc, argv) : 0;
 
-    int from = 1 + N/size*rank;
-    int to = (rank + 1 == size) ? (N+1) : (1 + N/size*(rank+1));
+    // Wall time of the computation and the output, N is not included
+    double start = MPI_Wtime();
 
-    calc_proc(from, to, digits, rank, size);
+    // Digits after the point checked by --verify, 0 - no check
+    std::size_t verify_prec = opts.verify ? prec : 0;
+
+    // 1 on the rank 0 if the digits don't match the reference
+    int verify_ret = 0;
+    if (opts.constant != CONST_E) {
+        verify_ret = calc_proc_const(opts, digits, rank, size, verify_prec);
+    } else if (opts.alg == ALG_BS) {
+        int from = 1 + N/size*rank;
+        int to = (rank + 1 == size) ? (N+1) : (1 + N/size*(rank+1));
+        verify_ret = calc_proc_bs(
+            from, to, digits, rank, size,
+            opts.reduction, verify_prec
+        );
+    } else if (opts.radix == RADIX_BIN) {
+        verify_ret = calc_proc<BinaryFixed>(
+            N, digits, rank, size,
+            opts.reduction, opts.threads, opts.checkpoint, verify_prec
+        );
+    } else {
+        verify_ret = calc_proc<Decimal>(
+            N, digits, rank, size,
+            opts.reduction, opts.threads, opts.checkpoint, verify_prec
+        );
+    }
 
     if (rank == 0) {
-        end = clock();
-        double delta_time = (static_cast<double>(end - start))
-                                                        / CLOCKS_PER_SEC;
-        std::cout << "time: " << delta_time << std::endl;
+        std::cout << "time: " << MPI_Wtime() - start << std::endl;
     }
+    check_ames(verify_ret == 0, "The digits don't match the reference");
 
     RET_IF_ERR(MPI_Finalize());
 
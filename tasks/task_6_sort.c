@@ -1,9 +1,18 @@
 /**
  * Different realisation of sort algorithms.
- * RUN: ./prog <mode> <sort_type> <count_per_proc>
+ * RUN: ./prog <mode> <sort_type> <count_per_proc> [oversample] [splitters]
+ *                                                     [threads] [pattern]
  * mode - One of the following:
  *        MODE_EXEC = 1,
  *        MODE_CHECK = 2,
+ *        MODE_TYPED = 3 - samplesort_dist_keys on all key types and
+ *            (key, index) pairs, sort_type is not used,
+ *        MODE_BENCH_RADIX = 4 - local radix sorts on 1e6, 1e7, ... up to
+ *            count_per_proc elements on the main rank, sort_type is not
+ *            used,
+ *        MODE_EMPTY_BUCKETS = 5 - parallel sorts of two distinct values,
+ *            so most buckets are empty on 3 and more procs, sort_type is
+ *            not used,
  * sort_type -
  *        SORTYPE_HEAP = 1,
  *        SORTYPE_QUICK = 2,
@@ -11,15 +20,38 @@
  *        SORTYPE_BINRADIX = 4,
  *        SORTYPE_SAMPLE = 5,
  *        SORTYPE_COMB = 6,
+ *        SORTYPE_SAMPLE_DIST = 7 - samplesort_dist, the array is split
+ *            unevenly between ranks and the sorted parts stay on them,
+ *        SORTYPE_LSD_RADIX = 8 - radixsort_lsd_i32 by 11-bit digits,
+ *        SORTYPE_INTRO = 9 - introsort,
+ * oversample - samples per rank of samplesort are oversample * procs, 4 by
+ *        default. It is used by the gathered splitters only.
+ * splitters - how samplesort finds the splitters:
+ *        SPLITTERS_HIST = 1 (default) - parallel histogram refinement,
+ *        SPLITTERS_GATHER = 2 - samples are sorted on the main rank,
+ * threads - threads of every rank for the local radix sort and the merge
+ *        of samplesort, 1 by default.
+ * pattern - input array of the time and correctness tests:
+ *        INPUT_RANDOM = 1 (default),
+ *        INPUT_SORTED = 2,
+ *        INPUT_REVERSE = 3,
+ *        INPUT_FEW_UNIQUE = 4 - 16 distinct values,
+ *        INPUT_ORGAN_PIPE = 5 - ascending then descending,
  */
 
 #include "mpi.h"
 #include "../slibs/err_proc.h"
 #include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 
 
 
@@ -27,6 +59,30 @@
 
 const int main_rank = 0;
 
+typedef enum SplittersType_t {
+    SPLITTERS_HIST = 1,
+    SPLITTERS_GATHER,
+} SplittersType;
+
+int oversample = 4;
+SplittersType splitters_type = SPLITTERS_HIST;
+
+// Max/mean of the bucket sizes of the last samplesort on the main rank
+double bucket_imbalance = 0;
+
+// Threads of a rank in samplesort, they never call MPI
+int threads_count = 1;
+
+typedef enum InputPattern_t {
+    INPUT_RANDOM = 1,
+    INPUT_SORTED,
+    INPUT_REVERSE,
+    INPUT_FEW_UNIQUE,
+    INPUT_ORGAN_PIPE,
+} InputPattern;
+
+InputPattern input_pattern = INPUT_RANDOM;
+
 // ------------------------------------ Nice things for working with arrays
 
 void print_arr(int *arr, int count) {
@@ -61,6 +117,28 @@ int *generate_random_array(int count, int max, int seed) {
     return arr;
 }
 
+// Test array of the pattern, the values are spread over [0, INT_MAX)
+int *generate_array(int count, InputPattern pattern, int seed) {
+    if (pattern == INPUT_RANDOM) {
+        return generate_random_array(count, INT_MAX, seed);
+    }
+    int step = count > 0 ? INT_MAX / count : 1;
+    int *arr = (int*) malloc(count*sizeof(int));
+    srand(seed);
+    for (int q = 0; q < count; ++q) {
+        switch (pattern) {
+            case INPUT_SORTED:     arr[q] = q * step; break;
+            case INPUT_REVERSE:    arr[q] = (count - 1 - q) * step; break;
+            case INPUT_FEW_UNIQUE: arr[q] = rand() % 16 * (INT_MAX/16); break;
+            case INPUT_ORGAN_PIPE:
+                arr[q] = (q < count/2 ? q : count - 1 - q) * step;
+                break;
+            default: check_ames(0, "Unknown input pattern");
+        }
+    }
+    return arr;
+}
+
 // --------------------------------------------------------------- heapsort
 // Standard heapsort realization
 
@@ -134,6 +212,174 @@ void quicksort(int *arr, int l, int r) {
     }
 }
 
+// ---------------------------------------------------------------- introsort
+// Quicksort that can not go quadratic or deep
+
+#define INTRO_INSERTION_CUTOFF 16
+#define INTRO_NINTHER_CUTOFF 128
+
+static void insertion_sort(int *arr, int l, int r) {
+    for (int q = l + 1; q <= r; ++q) {
+        int elem = arr[q];
+        int w = q - 1;
+        while (w >= l && arr[w] > elem) {
+            arr[w + 1] = arr[w];
+            --w;
+        }
+        arr[w + 1] = elem;
+    }
+}
+
+static inline int median_of_three(const int *arr, int a, int b, int c) {
+    if (arr[a] < arr[b]) {
+        return arr[b] < arr[c] ? b : (arr[a] < arr[c] ? c : a);
+    }
+    return arr[a] < arr[c] ? a : (arr[b] < arr[c] ? c : b);
+}
+
+// Median of three, or Tukey's ninther for long ranges
+static int choose_pivot(const int *arr, int l, int r) {
+    int m = l + (r - l) / 2;
+    if (r - l + 1 < INTRO_NINTHER_CUTOFF) {
+        return median_of_three(arr, l, m, r);
+    }
+    int step = (r - l + 1) / 8;
+    return median_of_three(
+        arr,
+        median_of_three(arr, l, l + step, l + 2*step),
+        median_of_three(arr, m - step, m, m + step),
+        median_of_three(arr, r - 2*step, r - step, r)
+    );
+}
+
+/*
+ * Bentley-McIlroy three-way partition around arr[l]: the equal elements
+ *    are kept at both ends while scanning and swapped to the middle at the
+ *    end. Afterwards [l, *lt) are less, [*lt, *gt] equal and (*gt, r]
+ *    greater than the pivot, so runs of duplicates drop out at once.
+ */
+static void partition3(int *arr, int l, int r, int *lt, int *gt) {
+    int v = arr[l];
+    int i = l;
+    int j = r + 1;
+    int p = l;
+    int q = r + 1;
+    while (1) {
+        while (arr[++i] < v) {
+            if (i == r) {
+                break;
+            }
+        }
+        while (v < arr[--j]) {
+            if (j == l) {
+                break;
+            }
+        }
+        if (i == j && arr[i] == v) {
+            swap_int(&arr[++p], &arr[i]);
+        }
+        if (i >= j) {
+            break;
+        }
+        swap_int(&arr[i], &arr[j]);
+        if (arr[i] == v) {
+            swap_int(&arr[++p], &arr[i]);
+        }
+        if (arr[j] == v) {
+            swap_int(&arr[--q], &arr[j]);
+        }
+    }
+    i = j + 1;
+    for (int w = l; w <= p; ++w) {
+        swap_int(&arr[w], &arr[j--]);
+    }
+    for (int w = r; w >= q; --w) {
+        swap_int(&arr[w], &arr[i++]);
+    }
+    *lt = j + 1;
+    *gt = i - 1;
+}
+
+/*
+ * Introsort of [l, r]: the loop goes on with the larger side and recurses
+ *    into the smaller one, so the stack is O(log n). After 2 log2(n)
+ *    levels the range is left to heapsort, ranges below the cutoff to
+ *    insertion sort.
+ */
+static void introsort_range(int *arr, int l, int r, int depth) {
+    while (r - l + 1 > INTRO_INSERTION_CUTOFF) {
+        if (depth == 0) {
+            heapsort(arr + l, r - l + 1);
+            return;
+        }
+        --depth;
+        swap_int(&arr[l], &arr[choose_pivot(arr, l, r)]);
+        int lt = 0;
+        int gt = 0;
+        partition3(arr, l, r, &lt, &gt);
+        if (lt - l < r - gt) {
+            introsort_range(arr, l, lt - 1, depth);
+            l = gt + 1;
+        } else {
+            introsort_range(arr, gt + 1, r, depth);
+            r = lt - 1;
+        }
+    }
+    insertion_sort(arr, l, r);
+}
+
+void introsort(int *arr, int count) {
+    int depth = 0;
+    for (int n = count; n > 1; n >>= 1) {
+        depth += 2;
+    }
+    introsort_range(arr, 0, count - 1, depth);
+}
+
+// --------------------------------------------------------------- key bits
+
+/*
+ * Every key maps to unsigned bits with the same order: signed ints get the
+ * sign bit flipped, negative floats get all bits flipped and positive ones
+ * the sign bit. Radix sort, splitters and merge look only at these bits,
+ * so -0.0 goes before +0.0 and NaNs go to the ends by their sign.
+ */
+
+static inline uint64_t key_bits_i32(int32_t key) {
+    return (uint32_t)key ^ 0x80000000u;
+}
+
+static inline uint64_t key_bits_i64(int64_t key) {
+    return (uint64_t)key ^ 0x8000000000000000ull;
+}
+
+static inline uint64_t key_bits_u64(uint64_t key) {
+    return key;
+}
+
+static inline uint64_t key_bits_f32(float key) {
+    uint32_t bits = 0;
+    memcpy(&bits, &key, sizeof(bits));
+    return bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+}
+
+static inline uint64_t key_bits_f64(double key) {
+    uint64_t bits = 0;
+    memcpy(&bits, &key, sizeof(bits));
+    return bits >> 63 ? ~bits : bits | 0x8000000000000000ull;
+}
+
+#define DEFINE_ELEM_BITS(T, sfx)                                            \
+    static inline uint64_t elem_bits_##sfx(const T *elem) {                 \
+        return key_bits_##sfx(*elem);                                       \
+    }
+
+DEFINE_ELEM_BITS(int32_t,  i32)
+DEFINE_ELEM_BITS(int64_t,  i64)
+DEFINE_ELEM_BITS(uint64_t, u64)
+DEFINE_ELEM_BITS(float,    f32)
+DEFINE_ELEM_BITS(double,   f64)
+
 // -------------------------------------------------------------- radixsort
 
 int getMax(int arr[], int n) {
@@ -144,7 +390,7 @@ int getMax(int arr[], int n) {
     return max;
 }
 
-void countingSort(int arr[], int *buf, int n, int exp) {
+void countingSort(int arr[], int *buf, int n, long long exp) {
     int count[10] = {0};
     for (int i = 0; i < n; i++) {
         count[(arr[i] / exp) % 10]++;
@@ -163,7 +409,7 @@ void countingSort(int arr[], int *buf, int n, int exp) {
 
 void radixsort(int arr[], int *buf, int n) {
     int max = getMax(arr, n);
-    for (int exp = 1; max / exp > 0; exp *= 10) {
+    for (long long exp = 1; max / exp > 0; exp *= 10) {
         countingSort(arr, buf, n, exp);
     }
 }
@@ -192,140 +438,809 @@ void radixsort_bin(int arr[], int *buf, int n) {
     }
 }
 
+/*
+ * LSD radix sort by digits of digit_bits (8 or 11) bits of the key bits,
+ *    so 4 or 3 passes for 32-bit keys. All histograms come from one read
+ *    pass and a digit equal in all keys takes no pass.
+ *    Arrays above the cache scatter through software write-combining:
+ *    every digit collects a cache line of elements and writes it out at
+ *    once with streaming stores, so the 2^digit_bits streams neither
+ *    thrash the cache nor read the destination lines first.
+ */
+#define RADIX_WC_LINE 64 // bytes of a cache line
+#define RADIX_WC_MIN_BYTES (1 << 20) // about the L2 size
+
+// Writes a full aligned line of the write-combining buffer
+static inline void radix_flush_line(void *dst, const void *line) {
+#ifdef __SSE2__
+    __m128i *out = (__m128i*)dst;
+    const __m128i *in = (const __m128i*)line;
+    _mm_stream_si128(out,     in[0]);
+    _mm_stream_si128(out + 1, in[1]);
+    _mm_stream_si128(out + 2, in[2]);
+    _mm_stream_si128(out + 3, in[3]);
+#else
+    memcpy(dst, line, RADIX_WC_LINE);
+#endif
+}
+
+// Orders the streaming stores before the following plain ones
+static inline void radix_flush_fence(void) {
+#ifdef __SSE2__
+    _mm_sfence();
+#endif
+}
+
+/*
+ * Radix sort of one element type: Elem is the element, name the suffix of
+ *    the functions, key_bits the width of the key bits and elem_bits gives
+ *    the key bits of an element. The element fills a cache line evenly.
+ */
+#define DEFINE_RADIX_LSD(Elem, name, key_bits, elem_bits)                   \
+    static inline unsigned radix_digit_##name(                              \
+        const Elem *elem,                                                   \
+        int shift,                                                          \
+        unsigned mask                                                       \
+    ) {                                                                     \
+        return (unsigned)(elem_bits(elem) >> shift) & mask;                 \
+    }                                                                       \
+                                                                            \
+    static void radix_scatter_wc_##name(                                    \
+        const Elem *src,                                                    \
+        Elem *dst,                                                          \
+        int n,                                                              \
+        int shift,                                                          \
+        int digits,                                                         \
+        int *offsets, /* line-aligned base of every digit, moves on */      \
+        int *fill,    /* elements of the line of every digit */             \
+        int *first,   /* first element of the line to write out */          \
+        Elem *wc      /* digits lines, aligned */                           \
+    ) {                                                                     \
+        enum { line_elems = RADIX_WC_LINE / sizeof(Elem) };                 \
+        _Static_assert(RADIX_WC_LINE % sizeof(Elem) == 0, "Elem size");     \
+        unsigned mask = digits - 1;                                         \
+        for (int d = 0; d < digits; ++d) {                                  \
+            uintptr_t address = (uintptr_t)(dst + offsets[d]);              \
+            fill[d] = address / sizeof(Elem) & (line_elems - 1);            \
+            first[d] = fill[d];                                             \
+            offsets[d] -= fill[d];                                          \
+        }                                                                   \
+        for (int q = 0; q < n; ++q) {                                       \
+            unsigned d = radix_digit_##name(&src[q], shift, mask);          \
+            Elem *line = wc + d*line_elems;                                 \
+            int f = fill[d];                                                \
+            line[f] = src[q];                                               \
+            if (f < line_elems - 1) {                                       \
+                fill[d] = f + 1;                                            \
+                continue;                                                   \
+            }                                                               \
+            if (first[d] == 0) {                                            \
+                radix_flush_line(dst + offsets[d], line);                   \
+            } else {                                                        \
+                memcpy(                                                     \
+                    dst + offsets[d] + first[d],                            \
+                    line + first[d],                                        \
+                    (line_elems - first[d]) * sizeof(Elem)                  \
+                );                                                          \
+                first[d] = 0;                                               \
+            }                                                               \
+            offsets[d] += line_elems;                                       \
+            fill[d] = 0;                                                    \
+        }                                                                   \
+        radix_flush_fence();                                                \
+        for (int d = 0; d < digits; ++d) {                                  \
+            memcpy(                                                         \
+                dst + offsets[d] + first[d],                                \
+                wc + d*line_elems + first[d],                               \
+                (fill[d] - first[d]) * sizeof(Elem)                         \
+            );                                                              \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    void radixsort_lsd_##name(                                              \
+        Elem *arr,                                                          \
+        Elem *buf,                                                          \
+        int n,                                                              \
+        int digit_bits                                                      \
+    ) {                                                                     \
+        check(digit_bits == 8 || digit_bits == 11);                         \
+        if (n < 2) {                                                        \
+            return;                                                         \
+        }                                                                   \
+        int digits = 1 << digit_bits;                                       \
+        unsigned mask = digits - 1;                                         \
+        int passes = ((key_bits) + digit_bits - 1) / digit_bits;            \
+                                                                            \
+        int *hists = (int*) calloc(passes * digits, sizeof(int));           \
+        for (int q = 0; q < n; ++q) {                                       \
+            uint64_t bits = elem_bits(&arr[q]);                             \
+            for (int w = 0; w < passes; ++w) {                              \
+                ++hists[w*digits + ((bits >> w*digit_bits) & mask)];        \
+            }                                                               \
+        }                                                                   \
+                                                                            \
+        int *fill = (int*) malloc(3 * digits * sizeof(int));                \
+        int *first = fill + digits;                                         \
+        int *offsets = first + digits;                                      \
+        Elem *wc = (Elem*) aligned_alloc(                                   \
+            RADIX_WC_LINE, digits * RADIX_WC_LINE                           \
+        );                                                                  \
+        Elem *src = arr;                                                    \
+        Elem *dst = buf;                                                    \
+        for (int w = 0; w < passes; ++w) {                                  \
+            int shift = w * digit_bits;                                     \
+            int *hist = hists + w*digits;                                   \
+            if (hist[radix_digit_##name(&src[0], shift, mask)] == n) {      \
+                continue;                                                   \
+            }                                                               \
+            int offset = 0;                                                 \
+            for (int d = 0; d < digits; ++d) {                              \
+                offsets[d] = offset;                                        \
+                offset += hist[d];                                          \
+            }                                                               \
+            if ((size_t)n * sizeof(Elem) < RADIX_WC_MIN_BYTES) {            \
+                for (int q = 0; q < n; ++q) {                               \
+                    unsigned d = radix_digit_##name(&src[q], shift, mask);  \
+                    dst[offsets[d]++] = src[q];                             \
+                }                                                           \
+            } else {                                                        \
+                radix_scatter_wc_##name(                                    \
+                    src, dst, n, shift, digits, offsets, fill, first, wc    \
+                );                                                          \
+            }                                                               \
+            Elem *t = src;                                                  \
+            src = dst;                                                      \
+            dst = t;                                                        \
+        }                                                                   \
+        if (src != arr) {                                                   \
+            memcpy(arr, src, n * sizeof(Elem));                             \
+        }                                                                   \
+                                                                            \
+        free(wc);                                                           \
+        free(fill);                                                         \
+        free(hists);                                                        \
+    }
+
+DEFINE_RADIX_LSD(int32_t, i32, 32, elem_bits_i32)
+
+// Runs func on every element of data_arr, the element 0 in this thread
+static void run_threads(
+    void *(*func)(void*),
+    void *data_arr,
+    size_t data_size,
+    int threads
+) {
+    pthread_t *pthread_arr = (pthread_t*) malloc(threads*sizeof(pthread_t));
+    for (int q = 1; q < threads; ++q) {
+        RET_IF_ERR(
+            pthread_create(
+                &pthread_arr[q],
+                NULL,
+                func,
+                (char*)data_arr + q*data_size
+            )
+        );
+    }
+    func(data_arr);
+    for (int q = 1; q < threads; ++q) {
+        RET_IF_ERR(pthread_join(pthread_arr[q], NULL));
+    }
+    free(pthread_arr);
+}
+
+#define RADIX_PAR_BITS 8
+#define RADIX_PAR_DIGITS (1 << RADIX_PAR_BITS)
+
+typedef struct RadixThread_t {
+    int rank;
+    int threads;
+    int *arr;
+    int *buf;
+    int count;
+    int *hists; // threads x RADIX_PAR_DIGITS, shared
+    pthread_barrier_t *barrier;
+} RadixThread;
+
+static inline int radix_par_digit(int elem, int shift) {
+    return (((unsigned)elem ^ 0x80000000u) >> shift) & (RADIX_PAR_DIGITS-1);
+}
+
+/*
+ * One pass: every thread counts the digits of its chunk, then takes its
+ *    offsets as the elements with a less digit plus the elements with the
+ *    same digit in the chunks before it, and scatters its chunk there.
+ *    Chunks keep their order, so the pass is stable.
+ */
+static void *radixsort_par_thread(void *data) {
+    RadixThread *dat = (RadixThread*)data;
+    int from = (long long)dat->count * dat->rank / dat->threads;
+    int to = (long long)dat->count * (dat->rank + 1) / dat->threads;
+    int *hist = dat->hists + dat->rank * RADIX_PAR_DIGITS;
+    int offsets[RADIX_PAR_DIGITS];
+    int *src = dat->arr;
+    int *dst = dat->buf;
+
+    for (int shift = 0; shift < 32; shift += RADIX_PAR_BITS) {
+        memset(hist, 0, RADIX_PAR_DIGITS * sizeof(int));
+        for (int q = from; q < to; ++q) {
+            ++hist[radix_par_digit(src[q], shift)];
+        }
+        pthread_barrier_wait(dat->barrier);
+
+        int offset = 0;
+        int same_digit = 0;
+        for (int d = 0; d < RADIX_PAR_DIGITS; ++d) {
+            int digit_count = 0;
+            for (int t = 0; t < dat->threads; ++t) {
+                int count = dat->hists[t*RADIX_PAR_DIGITS + d];
+                if (t == dat->rank) {
+                    offsets[d] = offset + digit_count;
+                }
+                digit_count += count;
+            }
+            same_digit |= digit_count == dat->count;
+            offset += digit_count;
+        }
+        // All threads see the same counts and skip the pass together
+        if (!same_digit) {
+            for (int q = from; q < to; ++q) {
+                dst[offsets[radix_par_digit(src[q], shift)]++] = src[q];
+            }
+            int *t = src;
+            src = dst;
+            dst = t;
+        }
+        pthread_barrier_wait(dat->barrier);
+    }
+    if (src != dat->arr) {
+        memcpy(dat->arr + from, src + from, (to - from) * sizeof(int));
+    }
+    return NULL;
+}
+
+// LSD radix sort by bytes in threads, any signs of the elements
+void radixsort_par(int *arr, int *buf, int count, int threads) {
+    check(threads > 0);
+    if (count < 2) {
+        return;
+    }
+    pthread_barrier_t barrier;
+    RET_IF_ERR(pthread_barrier_init(&barrier, NULL, threads));
+    int *hists = (int*) malloc(threads * RADIX_PAR_DIGITS * sizeof(int));
+    RadixThread *data_arr = (RadixThread*) malloc(
+        threads * sizeof(RadixThread)
+    );
+    for (int q = 0; q < threads; ++q) {
+        data_arr[q] = (RadixThread) {
+            .rank = q,
+            .threads = threads,
+            .arr = arr,
+            .buf = buf,
+            .count = count,
+            .hists = hists,
+            .barrier = &barrier,
+        };
+    }
+    run_threads(radixsort_par_thread, data_arr, sizeof(RadixThread), threads);
+
+    free(data_arr);
+    free(hists);
+    RET_IF_ERR(pthread_barrier_destroy(&barrier));
+}
+
 // ------------------------------------------------------------- samplesort
 
-static void calc_splitters(
+static void calc_displs(const int *count_arr, int *displs, int count) {
+    int displ = 0;
+    for (int q = 0; q < count; ++q) {
+        displs[q] = displ;
+        displ += count_arr[q];
+    }
+}
+
+/*
+ * Tournament (loser) tree over the buckets: node 0 keeps the bucket with
+ *    the least head, every inner node n of 1..count-1 keeps the bucket that
+ *    lost the match in it, the leaf of the bucket q is the node count + q.
+ *    A node packs the key bits of the head above the bucket index, so a
+ *    match is one unsigned min/max without branches. An exhausted bucket
+ *    plays with the key 2^key_bits above all others, so nodes of 64-bit
+ *    keys are 128-bit.
+ */
+#define LOSER_TREE_SHIFT 31
+#define LOSER_TREE_INDEX_MASK ((1ULL << LOSER_TREE_SHIFT) - 1)
+
+/*
+ * The buckets of count_arr sizes lie in buf one after another. Elements
+ *    go out one by one until the same bucket wins MERGE_MIN_GALLOP times
+ *    in a row, then all its elements up to the runner-up go out as one
+ *    block. Interleaved buckets never pay for the search, long runs are
+ *    copied by memcpy.
+ */
+#define MERGE_MIN_GALLOP 4
+
+typedef unsigned long long LoserNode32;
+typedef unsigned __int128 LoserNode64;
+
+
+/*
+ * Merge of one element type: Elem is the element, name the suffix of the
+ *    functions, Node the unsigned type of the loser tree nodes, key_bits
+ *    the width of the key bits and elem_bits gives the key bits of an
+ *    element.
+ */
+#define DEFINE_MERGE_RUNS(Elem, name, Node, key_bits, elem_bits)            \
+    /* Count of elements of the sorted arr with key bits not above bits */  \
+    static int count_not_greater_##name(                                    \
+        const void *arr,                                                    \
+        int count,                                                          \
+        uint64_t bits                                                       \
+    ) {                                                                     \
+        const Elem *elems = (const Elem*) arr;                              \
+        int l = 0;                                                          \
+        int r = count;                                                      \
+        while (l < r) {                                                     \
+            int m = l + (r - l) / 2;                                        \
+            if (elem_bits(&elems[m]) <= bits) {                             \
+                l = m + 1;                                                  \
+            } else {                                                        \
+                r = m;                                                      \
+            }                                                               \
+        }                                                                   \
+        return l;                                                           \
+    }                                                                       \
+                                                                            \
+    typedef struct LoserTree_##name##_t {                                   \
+        Node *nodes;                                                        \
+        const Elem **heads;                                                 \
+        const Elem **ends;                                                  \
+        int count;                                                          \
+    } LoserTree_##name;                                                     \
+                                                                            \
+    static inline Node loser_tree_node_##name(                              \
+        const LoserTree_##name *lt,                                         \
+        int backet                                                          \
+    ) {                                                                     \
+        Node key = (Node)1 << (key_bits);                                   \
+        if (lt->heads[backet] != lt->ends[backet]) {                        \
+            key = elem_bits(lt->heads[backet]);                             \
+        }                                                                   \
+        return key << LOSER_TREE_SHIFT | backet;                            \
+    }                                                                       \
+                                                                            \
+    static inline int loser_tree_winner_##name(                             \
+        const LoserTree_##name *lt                                          \
+    ) {                                                                     \
+        return lt->nodes[0] & LOSER_TREE_INDEX_MASK;                        \
+    }                                                                       \
+                                                                            \
+    static void loser_tree_init_##name(LoserTree_##name *lt) {              \
+        int count = lt->count;                                              \
+        Node *winners = (Node*) malloc(2 * count * sizeof(Node));           \
+        for (int q = 0; q < count; ++q) {                                   \
+            winners[count + q] = loser_tree_node_##name(lt, q);             \
+        }                                                                   \
+        for (int q = count - 1; q > 0; --q) {                               \
+            Node l = winners[2*q];                                          \
+            Node r = winners[2*q + 1];                                      \
+            winners[q] = l < r ? l : r;                                     \
+            lt->nodes[q] = l < r ? r : l;                                   \
+        }                                                                   \
+        /* For one bucket the node 1 is its leaf */                         \
+        lt->nodes[0] = winners[1];                                          \
+        free(winners);                                                      \
+    }                                                                       \
+                                                                            \
+    /* Plays the bucket again from its leaf up after its head moved */      \
+    static inline void loser_tree_replay_##name(                            \
+        LoserTree_##name *lt,                                               \
+        int backet                                                          \
+    ) {                                                                     \
+        Node winner = loser_tree_node_##name(lt, backet);                   \
+        for (int q = (backet + lt->count) / 2; q > 0; q /= 2) {             \
+            Node node = lt->nodes[q];                                       \
+            lt->nodes[q] = node < winner ? winner : node;                   \
+            winner = node < winner ? node : winner;                         \
+        }                                                                   \
+        lt->nodes[0] = winner;                                              \
+    }                                                                       \
+                                                                            \
+    /* The least of the losers on the path of the winner is the */          \
+    /*     runner-up, the result is the key bits of its head */             \
+    static inline Node loser_tree_runner_up_##name(                         \
+        const LoserTree_##name *lt                                          \
+    ) {                                                                     \
+        Node runner_up = ~(Node)0;                                          \
+        int winner = loser_tree_winner_##name(lt);                          \
+        for (int q = (winner + lt->count) / 2; q > 0; q /= 2) {             \
+            if (lt->nodes[q] < runner_up) {                                 \
+                runner_up = lt->nodes[q];                                   \
+            }                                                               \
+        }                                                                   \
+        return runner_up >> LOSER_TREE_SHIFT;                               \
+    }                                                                       \
+                                                                            \
+    /* Count of elements of the sorted arr with key bits not above bits, */ \
+    /*     the search goes from the start with doubling steps */            \
+    static inline int gallop_not_greater_##name(                            \
+        const Elem *arr,                                                    \
+        int count,                                                          \
+        Node bits                                                           \
+    ) {                                                                     \
+        int r = 1;                                                          \
+        while (r < count && elem_bits(&arr[r]) <= bits) {                   \
+            r *= 2;                                                         \
+        }                                                                   \
+        int l = r / 2;                                                      \
+        if (r > count) {                                                    \
+            r = count;                                                      \
+        }                                                                   \
+        while (l < r) {                                                     \
+            int m = l + (r - l) / 2;                                        \
+            if (elem_bits(&arr[m]) <= bits) {                               \
+                l = m + 1;                                                  \
+            } else {                                                        \
+                r = m;                                                      \
+            }                                                               \
+        }                                                                   \
+        return l;                                                           \
+    }                                                                       \
+                                                                            \
+    /* Merges the sorted runs [heads[q], ends[q]), the heads move on */     \
+    static void merge_runs_##name(                                          \
+        const Elem **heads,                                                 \
+        const Elem **ends,                                                  \
+        int runs_count,                                                     \
+        Elem *help_buf                                                      \
+    ) {                                                                     \
+        int new_buf_size = 0;                                               \
+        for (int q = 0; q < runs_count; ++q) {                              \
+            new_buf_size += ends[q] - heads[q];                             \
+        }                                                                   \
+        LoserTree_##name lt = {                                             \
+            .nodes = (Node*) malloc(runs_count * sizeof(Node)),             \
+            .heads = heads,                                                 \
+            .ends = ends,                                                   \
+            .count = runs_count,                                            \
+        };                                                                  \
+        loser_tree_init_##name(&lt);                                        \
+                                                                            \
+        int prev_winner = -1;                                               \
+        int wins = 0;                                                       \
+        int buf_pointer = 0;                                                \
+        while (buf_pointer < new_buf_size) {                                \
+            int winner = loser_tree_winner_##name(&lt);                     \
+            wins = winner == prev_winner ? wins + 1 : 0;                    \
+            if (wins < MERGE_MIN_GALLOP) {                                  \
+                help_buf[buf_pointer++] = *heads[winner]++;                 \
+            } else {                                                        \
+                wins = 0;                                                   \
+                int block = gallop_not_greater_##name(                      \
+                    heads[winner], ends[winner] - heads[winner],            \
+                    loser_tree_runner_up_##name(&lt)                        \
+                );                                                          \
+                memcpy(                                                     \
+                    help_buf + buf_pointer, heads[winner],                  \
+                    block * sizeof(Elem)                                    \
+                );                                                          \
+                buf_pointer += block;                                       \
+                heads[winner] += block;                                     \
+            }                                                               \
+            prev_winner = winner;                                           \
+            loser_tree_replay_##name(&lt, winner);                          \
+        }                                                                   \
+                                                                            \
+        free(lt.nodes);                                                     \
+    }                                                                       \
+                                                                            \
+    static void merge_backets_##name(                                       \
+        const void *buf,                                                    \
+        void *help_buf,                                                     \
+        int backets_count,                                                  \
+        const int *count_arr,                                               \
+        int *new_count                                                      \
+    ) {                                                                     \
+        const Elem *elems = (const Elem*) buf;                              \
+        int new_buf_size = 0;                                               \
+        const Elem **heads = (const Elem**) malloc(                         \
+            2 * backets_count * sizeof(Elem*)                               \
+        );                                                                  \
+        const Elem **ends = heads + backets_count;                          \
+        for (int q = 0; q < backets_count; ++q) {                           \
+            heads[q] = elems + new_buf_size;                                \
+            new_buf_size += count_arr[q];                                   \
+            ends[q] = elems + new_buf_size;                                 \
+        }                                                                   \
+        merge_runs_##name(heads, ends, backets_count, (Elem*) help_buf);    \
+        free(heads);                                                        \
+                                                                            \
+        *new_count = new_buf_size;                                          \
+    }
+
+DEFINE_MERGE_RUNS(int32_t, i32, LoserNode32, 32, elem_bits_i32)
+
+// Count of elements of the sorted arr that are not greater than value
+static int count_not_greater(const int *arr, int count, long long value) {
+    if (value < INT_MIN) {
+        return 0;
+    }
+    if (value > INT_MAX) {
+        return count;
+    }
+    return count_not_greater_i32(arr, count, key_bits_i32(value));
+}
+
+/*
+ * Regular oversampling: every rank takes oversample * size samples at the
+ * starts of equal parts of its sorted array, so every rank has one sample
+ * at the quantile q / size of its elements. The main rank sorts all of
+ * them and the splitter q is the middle one of these size samples.
+ * Ranks with fewer elements give fewer samples, the splitters are exact
+ * quantiles only for equal local counts.
+ */
+static void calc_splitters_gather(
     int *self_arr,
     int *splitters,
     int count,
     int rank,
     int size
 ) {
-    int splitters_count = size;
-    for (int q = 0; q < size; ++q) {
-        splitters[q] = self_arr[q*count/size];
+    int samples_count = oversample * size;
+    if (samples_count > count) {
+        samples_count = count;
+    }
+    int *samples = (int*) malloc(samples_count * sizeof(int));
+    for (int q = 0; q < samples_count; ++q) {
+        samples[q] = self_arr[(long long)q * count / samples_count];
     }
 
-    int all_splitters_count = splitters_count * size;
-    int *all_splitters = NULL;
+    int *samples_counts = NULL;
+    int *samples_displs = NULL;
     if (rank == main_rank) {
-        all_splitters = (int*) malloc(all_splitters_count*sizeof(int));
+        samples_counts = (int*) malloc(2 * size * sizeof(int));
+        samples_displs = samples_counts + size;
     }
-
     RET_IF_ERR(
         MPI_Gather(
-            splitters, splitters_count, MPI_INT, 
-            all_splitters, splitters_count, MPI_INT, 
+            &samples_count, 1, MPI_INT,
+            samples_counts, 1, MPI_INT,
+            main_rank, MPI_COMM_WORLD
+        )
+    );
+
+    int all_samples_count = 0;
+    int *all_samples = NULL;
+    if (rank == main_rank) {
+        calc_displs(samples_counts, samples_displs, size);
+        all_samples_count = samples_displs[size-1] + samples_counts[size-1];
+        all_samples = (int*) malloc(all_samples_count*sizeof(int));
+    }
+
+    RET_IF_ERR(
+        MPI_Gatherv(
+            samples, samples_count, MPI_INT,
+            all_samples, samples_counts, samples_displs, MPI_INT,
             main_rank, MPI_COMM_WORLD
         )
     )
 
     if (rank == main_rank) {
-        quicksort(all_splitters, 0, all_splitters_count - 1);
+        introsort(all_samples, all_samples_count);
+        // The offset stays inside one step, so the last splitter is
+        //     in range even when a few samples are taken
         int offset = size/2 - 1;
+        int step = all_samples_count / size;
+        if (offset > step - 1) {
+            offset = step - 1;
+        }
+        if (offset < 0) {
+            offset = 0;
+        }
         for (int q = 1; q < size; ++q) {
-            splitters[q-1] = all_splitters[q*size + offset];
+            long long ind = (long long)q * all_samples_count / size + offset;
+            splitters[q-1] = all_samples_count == 0
+                ? INT_MAX : all_samples[ind];
         }
-        free(all_splitters);
+        free(all_samples);
+        free(samples_counts);
     }
+    free(samples);
 
     RET_IF_ERR(
         MPI_Bcast(
-            splitters, splitters_count-1, MPI_INT,
+            splitters, size-1, MPI_INT,
             main_rank, MPI_COMM_WORLD
         )
     );
 }
 
+/*
+ * Histogram refinement: the splitter q is the least value with at least
+ * q / size of all elements not greater than it. All splitters are found
+ * by bisection on the value at once, one step counts the elements not
+ * greater than the candidates by binary search in the sorted arrays and
+ * sums the counts with one Allreduce. Ints need at most 32 steps and no
+ * rank does more than O(size log count) work in a step.
+ */
+static void calc_splitters_hist(
+    int *self_arr,
+    int *splitters,
+    int count,
+    int size
+) {
+    // -min and max of all elements in one reduction
+    long long bounds[2] = {LLONG_MIN, LLONG_MIN};
+    if (count > 0) {
+        bounds[0] = -(long long)self_arr[0];
+        bounds[1] = self_arr[count - 1];
+    }
+    RET_IF_ERR(
+        MPI_Allreduce(
+            MPI_IN_PLACE, bounds, 2, MPI_LONG_LONG,
+            MPI_MAX, MPI_COMM_WORLD
+        )
+    );
+    long long total = count;
+    RET_IF_ERR(
+        MPI_Allreduce(
+            MPI_IN_PLACE, &total, 1, MPI_LONG_LONG,
+            MPI_SUM, MPI_COMM_WORLD
+        )
+    );
+    if (total == 0) {
+        for (int q = 0; q < size - 1; ++q) {
+            splitters[q] = INT_MAX;
+        }
+        return;
+    }
+
+    // The count of lo is less than the share, the count of hi is not
+    int splitters_count = size - 1;
+    long long *lo = (long long*) malloc(3 * splitters_count
+                                                    * sizeof(long long));
+    long long *hi = lo + splitters_count;
+    long long *counts = hi + splitters_count;
+    for (int q = 0; q < splitters_count; ++q) {
+        lo[q] = -bounds[0] - 1;
+        hi[q] = bounds[1];
+    }
+
+    // Every rank has the same brackets, so it makes the same steps
+    int active = 1;
+    while (active) {
+        for (int q = 0; q < splitters_count; ++q) {
+            counts[q] = count_not_greater(
+                self_arr, count, lo[q] + (hi[q] - lo[q]) / 2
+            );
+        }
+        RET_IF_ERR(
+            MPI_Allreduce(
+                MPI_IN_PLACE, counts, splitters_count, MPI_LONG_LONG,
+                MPI_SUM, MPI_COMM_WORLD
+            )
+        );
+        active = 0;
+        for (int q = 0; q < splitters_count; ++q) {
+            long long mid = lo[q] + (hi[q] - lo[q]) / 2;
+            if (hi[q] - lo[q] <= 1) {
+                continue;
+            }
+            if (counts[q] >= total * (q + 1) / size) {
+                hi[q] = mid;
+            } else {
+                lo[q] = mid;
+            }
+            active |= hi[q] - lo[q] > 1;
+        }
+    }
+
+    for (int q = 0; q < splitters_count; ++q) {
+        splitters[q] = (int)hi[q];
+    }
+    free(lo);
+}
+
+static void calc_splitters(
+    int *self_arr,
+    int *splitters,
+    int count,
+    int rank,
+    int size
+) {
+    switch (splitters_type) {
+        case SPLITTERS_HIST:
+            calc_splitters_hist(self_arr, splitters, count, size);
+            break;
+        case SPLITTERS_GATHER:
+            calc_splitters_gather(self_arr, splitters, count, rank, size);
+            break;
+        default: check_ames(0, "Unknown splitters type");
+    }
+}
+
+/*
+ * The sorted buf is already laid out by buckets, only their sizes are
+ * counted: the bucket q holds the elements in (splitters[q-1], splitters[q]]
+ */
 static void separate_elements(
-    int *buf, int buf_size,
-    int backet_size,
+    const int *buf, int buf_size,
     int backets_count,
     int *count_arr,
-    int *splitters
+    const int *splitters
 ) {
-    int backet_offset = 0;
-    int backet_position = 0;
-    int buf_pointer = 0;
-    int elements_count = backet_size;
+    int prev = 0;
     for (int backet = 0; backet < backets_count - 1; ++backet) {
-        while (buf[buf_pointer] <= splitters[backet]
-               && buf_pointer < elements_count
-        ) {
-            buf[backet*backet_size + backet_position] = buf[buf_pointer];
-            ++backet_position;
-            ++buf_pointer;
-        }
-        count_arr[backet] = backet_position;
-        backet_position = 0;
-    }
-    backet_offset = (backets_count-1)*backet_size;
-    while (buf_pointer < elements_count) {
-        buf[backet_offset + backet_position] = buf[buf_pointer];
-        ++backet_position;
-        ++buf_pointer;
+        int end = count_not_greater(buf, buf_size, splitters[backet]);
+        count_arr[backet] = end - prev;
+        prev = end;
     }
-    count_arr[backets_count - 1] = backet_position;
+    count_arr[backets_count - 1] = buf_size - prev;
 }
 
 static void test_separate_elements() {
 
-    int arr[64] = {
+    int arr[16] = {
         3, 10, 18, 30, 31, 33, 40, 49, 51, 64, 66, 69, 70, 77, 79, 91
     };
     int splitters[3] = {30, 51, 72};
     int count_arr[4] = {0};
 
     separate_elements(
-        arr, 64,
-        16,
+        arr, 16,
         4,
         count_arr,
         splitters
     );
 
-    int arr_valid1[] = {3, 10, 18, 30};
-    int arr_valid2[] = {31, 33, 40, 49, 51};
-    int arr_valid3[] = {64, 66, 69, 70};
-    int arr_valid4[] = {77, 79, 91};
-    for (int q = 0; q < 16; ++q) {
-        if (q < 4) check(arr[ 0 + q] == arr_valid1[q]);
-        if (q < 5) check(arr[16 + q] == arr_valid2[q]);
-        if (q < 4) check(arr[32 + q] == arr_valid3[q]);
-        if (q < 3) check(arr[48 + q] == arr_valid4[q]);
-    }
     check(count_arr[0] == 4);
     check(count_arr[1] == 5);
     check(count_arr[2] == 4);
     check(count_arr[3] == 3);
 }
 
+/*
+ * Every bucket goes to its rank with its exact size. On return count_arr
+ *    holds the sizes of the received buckets, they lie one after another
+ *    in *new_backets of *new_count elements allocated here. Elements are
+ *    of elem_size bytes and go as the given MPI type.
+ */
 static void swap_backets(
-    int **buckets,
-    int *new_backets,
+    const void *buckets,
+    void **new_backets,
+    MPI_Datatype type,
+    size_t elem_size,
     int backets_count,
-    int backets_size,
-    int *count_arr
+    int *count_arr,
+    int *new_count
 ) {
-
-    int *temp_count_arr = (int*) malloc(backets_count * sizeof(int));
+    int *recv_count_arr = (int*) malloc(backets_count * sizeof(int));
+    int *send_displs = (int*) malloc(backets_count * sizeof(int));
+    int *recv_displs = (int*) malloc(backets_count * sizeof(int));
     RET_IF_ERR(
         MPI_Alltoall(
             count_arr, 1, MPI_INT,
-            temp_count_arr, 1, MPI_INT,
+            recv_count_arr, 1, MPI_INT,
             MPI_COMM_WORLD
         )
     );
-    memcpy(count_arr, temp_count_arr, backets_count * sizeof(int));
-    free(temp_count_arr);
+    calc_displs(count_arr, send_displs, backets_count);
+    calc_displs(recv_count_arr, recv_displs, backets_count);
+    *new_count = recv_displs[backets_count - 1]
+                 + recv_count_arr[backets_count - 1];
+    *new_backets = malloc(*new_count * elem_size);
 
     RET_IF_ERR(
-        MPI_Alltoall(
-            *buckets, backets_size, MPI_INT,
-            new_backets, backets_size, MPI_INT,
+        MPI_Alltoallv(
+            buckets, count_arr, send_displs, type,
+            *new_backets, recv_count_arr, recv_displs, type,
             MPI_COMM_WORLD
         )
     );
+    memcpy(count_arr, recv_count_arr, backets_count * sizeof(int));
+
+    free(recv_count_arr);
+    free(send_displs);
+    free(recv_displs);
 }
 
 static inline void merge(
@@ -360,63 +1275,101 @@ static inline void merge(
     }
 }
 
-static inline int find_backet_with_min_elem(
-    int backet_size,
-    int backets_count,
-    const int *const *pointers,
-    const int *count_arr
-) {
-    int min = 0;
-    int backet_ind = 0;
-    for (int q = 0; q < backets_count; ++q) {
-        if (count_arr[q] > 0) {
-            min = *pointers[q];
-            backet_ind = q;
-            break;
-        }
-    }
-    for (int q = 0; q < backets_count; ++q) {
-        if (count_arr[q] > 0) {
-            int elem = *pointers[q];
-            if (elem < min) {
-                min = elem;
-                backet_ind = q;
-            }
-        }
-    }
-    return backet_ind;
+typedef struct MergeThread_t {
+    const int **heads; // runs_count slices of the buckets
+    const int **ends;
+    int runs_count;
+    int *dst;
+} MergeThread;
+
+static void *merge_runs_thread(void *data) {
+    MergeThread *dat = (MergeThread*)data;
+    merge_runs_i32(dat->heads, dat->ends, dat->runs_count, dat->dst);
+    return NULL;
 }
 
-static void merge_backets(
+/*
+ * merge_backets in threads: the value bound of the thread t is the least
+ *    value with at least t / threads of all elements not greater than it,
+ *    found by bisection. Every thread merges the slices of the buckets
+ *    between its bounds into its own part of help_buf.
+ */
+static void merge_backets_par(
     const int *buf,
     int *help_buf,
-    int buf_size,
     int backets_count,
-    int *count_arr,
-    int *new_count
+    const int *count_arr,
+    int *new_count,
+    int threads
 ) {
-    int backet_size = buf_size/backets_count;
-    int new_buf_size = 0;
-    for (int q = 0; q < backets_count; ++q) {
-        new_buf_size += count_arr[q];
+    int k = backets_count;
+    const int **runs = (const int**) malloc(
+        (threads + 1) * k * sizeof(int*)
+    );
+    long long lo_all = INT_MAX;
+    long long hi_all = INT_MIN;
+    int total = 0;
+    for (int q = 0; q < k; ++q) {
+        runs[q] = buf + total;
+        if (count_arr[q] > 0) {
+            lo_all = lo_all < buf[total] ? lo_all : buf[total];
+            total += count_arr[q];
+            hi_all = hi_all > buf[total-1] ? hi_all : buf[total-1];
+        }
+        runs[threads*k + q] = buf + total;
     }
 
-    const int **pointers = (const int**) malloc(buf_size * sizeof(int*));
-    for (int q = 0; q < backets_count; ++q) {
-        pointers[q] = buf + q*backet_size;
+    // runs[t*k + q] is where the slice of the thread t in the bucket q starts
+    for (int t = 1; t < threads; ++t) {
+        long long share = (long long)total * t / threads;
+        long long lo = lo_all - 1;
+        long long hi = hi_all;
+        while (hi - lo > 1) {
+            long long mid = lo + (hi - lo) / 2;
+            long long count = 0;
+            for (int q = 0; q < k; ++q) {
+                count += count_not_greater(
+                    runs[q], runs[threads*k + q] - runs[q], mid
+                );
+            }
+            if (count >= share) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        for (int q = 0; q < k; ++q) {
+            runs[t*k + q] = runs[q] + count_not_greater(
+                runs[q], runs[threads*k + q] - runs[q], hi
+            );
+        }
     }
-    for (int buf_pointer = 0; buf_pointer < new_buf_size; ++buf_pointer) {
-        int min = find_backet_with_min_elem(
-            backet_size, backets_count, pointers, count_arr
-        );        
-        help_buf[buf_pointer] = *pointers[min];
-        count_arr[min] -= 1;
-        pointers[min] += 1;
+
+    // Threads move their heads, which are the ends of the previous thread
+    const int **heads = (const int**) malloc(threads * k * sizeof(int*));
+    memcpy(heads, runs, threads * k * sizeof(int*));
+    MergeThread *data_arr = (MergeThread*) malloc(
+        threads * sizeof(MergeThread)
+    );
+    int offset = 0;
+    for (int t = 0; t < threads; ++t) {
+        data_arr[t] = (MergeThread) {
+            .heads = heads + t*k,
+            .ends = runs + (t+1)*k,
+            .runs_count = k,
+            .dst = help_buf + offset,
+        };
+        for (int q = 0; q < k; ++q) {
+            offset += runs[(t+1)*k + q] - runs[t*k + q];
+        }
     }
+    run_threads(merge_runs_thread, data_arr, sizeof(MergeThread), threads);
 
-    free(pointers);
+    free(data_arr);
+    free(heads);
+    free(runs);
 
-    *new_count = new_buf_size;
+    *new_count = total;
 }
 
 static inline int is_receiver(int rank, int size, int q) {
@@ -450,25 +1403,43 @@ static inline void update_counts(int *counts_arr, int count, int q) {
     }
 }
 
+// Elements count that gather_backets collects on the rank
+static int calc_gather_capacity(const int *counts_arr, int rank, int size) {
+    int span = size;
+    if (rank != 0) {
+        span = rank & -rank;
+    }
+    int capacity = 0;
+    for (int q = rank; q < rank + span && q < size; ++q) {
+        capacity += counts_arr[q];
+    }
+    return capacity;
+}
+
+/*
+ * Binomial tree gather: the sorted parts are merged pairwise on the way to
+ *    the main rank, which gets the whole sorted array in ret_arr.
+ */
 static void gather_backets(
-    int *buf_arr, // len = arr size
-    int *buf_recv, // len = arr size
-    int *buf_merge, // len = arr size
-    int *counts_arr, // len = proc count // For elems_counts
-    int elements_count,
+    const int *self_arr,
+    int *counts_arr, // len = proc count // Elements counts of all ranks
     int buf_size,
     int rank,
     int size,
     int *ret_arr
 ) {
-    
-    RET_IF_ERR(
-        MPI_Allgather(
-            &elements_count, 1, MPI_INT, 
-            counts_arr, 1, MPI_INT, 
-            MPI_COMM_WORLD
-        )
-    );
+    int capacity = calc_gather_capacity(counts_arr, rank, size);
+    int *buf = NULL;
+    int *buf_recv = NULL;
+    int *buf_merge = NULL;
+    int *buf_spare = NULL;
+    if (capacity > counts_arr[rank]) {
+        buf = (int*) malloc(3 * capacity * sizeof(int));
+        buf_recv = buf;
+        buf_merge = buf + capacity;
+        buf_spare = buf + 2*capacity;
+    }
+    const int *buf_arr = self_arr;
 
     const int TAG = 0;
     for (int q = 1; q < size; q *= 2) {
@@ -482,12 +1453,16 @@ static void gather_backets(
                     MPI_COMM_WORLD, MPI_STATUS_IGNORE
                 )
             );
-            merge(
-                buf_merge,
-                buf_arr, counts_arr[rank],
-                buf_recv, counts_arr[sender_rank]
-            );
-            swap_pointers(&buf_merge, &buf_arr);
+            // Buffers exist only if something comes, an empty part is skipped
+            if (recv_count > 0) {
+                merge(
+                    buf_merge,
+                    buf_arr, counts_arr[rank],
+                    buf_recv, counts_arr[sender_rank]
+                );
+                buf_arr = buf_merge;
+                swap_pointers(&buf_merge, &buf_spare);
+            }
             update_counts(counts_arr, size, q);
         } else if (is_sender(rank, size, q)) {
             int receiver_rank = calc_receiver_rank(rank, size, q);
@@ -497,20 +1472,19 @@ static void gather_backets(
                     receiver_rank, TAG, MPI_COMM_WORLD
                 )
             );
-            return;
+            break;
         }
     }
     if (rank == main_rank) {
         memcpy(ret_arr, buf_arr, buf_size*sizeof(int));
-        return;
     }
+    free(buf);
 }
 
 static void separate_on_backets(
     int *self_arr,
     int *count_arr,
     int self_count,
-    int count,
     int rank,
     int size
 ) {
@@ -519,8 +1493,7 @@ static void separate_on_backets(
     calc_splitters(self_arr, splitters, self_count, rank, size);
 
     separate_elements(
-        self_arr, count,
-        self_count,
+        self_arr, self_count,
         size,
         count_arr,
         splitters
@@ -529,36 +1502,98 @@ static void separate_on_backets(
     free(splitters);
 }
 
-static void merge_into_arr(
+// Max/mean of the bucket sizes goes into bucket_imbalance on the main rank
+static void report_imbalance(int bucket_count, int rank, int size) {
+    int max_count = 0;
+    long long self_count = bucket_count;
+    long long sum_count = 0;
+    RET_IF_ERR(
+        MPI_Reduce(
+            &bucket_count, &max_count, 1, MPI_INT,
+            MPI_MAX, main_rank, MPI_COMM_WORLD
+        )
+    );
+    RET_IF_ERR(
+        MPI_Reduce(
+            &self_count, &sum_count, 1, MPI_LONG_LONG,
+            MPI_SUM, main_rank, MPI_COMM_WORLD
+        )
+    );
+    if (rank == main_rank) {
+        bucket_imbalance = (double)max_count * size / sum_count;
+    }
+}
+
+// Index of the first element of the rank in the array of all ranks parts
+static long long calc_global_offset(int count, int rank) {
+    long long self_count = count;
+    long long offset = 0;
+    RET_IF_ERR(
+        MPI_Exscan(
+            &self_count, &offset, 1, MPI_LONG_LONG,
+            MPI_SUM, MPI_COMM_WORLD
+        )
+    );
+    return rank == 0 ? 0 : offset;
+}
+
+/*
+ * Distributed samplesort: every rank gives its local part self_arr of the
+ *    input, of any size, and nothing goes through the main rank. The rank
+ *    gets its part of the sorted array in *ret_arr (*ret_count elements,
+ *    allocated here, parts follow the rank order) and *ret_offset is the
+ *    index of its first element in the whole sorted array. self_arr is
+ *    sorted in place.
+ */
+void samplesort_dist(
     int *self_arr,
-    int *count_arr,
     int self_count,
-    int count,
+    int **ret_arr,
+    int *ret_count,
+    long long *ret_offset,
     int rank,
-    int size,
-    int *ret_arr
+    int size
 ) {
-    int new_count = 0;
-    int *new_buf1 = (int*) malloc(2 * count * sizeof(int));
-    int *new_buf2 = new_buf1 + count;
+    check(self_count == 0 || self_arr);
+    check(ret_arr && ret_count && ret_offset);
 
-    swap_backets(&self_arr, new_buf1, size, self_count, count_arr);
+    if (self_count > 0) {
+        int *help_arr = (int*) malloc(self_count * sizeof(int));
+        if (threads_count > 1) {
+            radixsort_par(self_arr, help_arr, self_count, threads_count);
+        } else {
+            radixsort_lsd_i32(self_arr, help_arr, self_count, 11);
+        }
+        free(help_arr);
+    }
 
-    merge_backets(new_buf1, self_arr, count, size, count_arr, &new_count);
+    int *count_arr = (int*) malloc(size * sizeof(int));
+    separate_on_backets(self_arr, count_arr, self_count, rank, size);
 
-    gather_backets(
-        self_arr, new_buf1, new_buf2, count_arr,
-        new_count, count,
-        rank, size,
-        ret_arr
+    int recv_count = 0;
+    int *recv_buf = NULL;
+    swap_backets(
+        self_arr, (void**)&recv_buf, MPI_INT, sizeof(int),
+        size, count_arr, &recv_count
     );
 
-    free(new_buf1);
+    *ret_arr = (int*) malloc(recv_count * sizeof(int));
+    if (threads_count > 1) {
+        merge_backets_par(
+            recv_buf, *ret_arr, size, count_arr, ret_count, threads_count
+        );
+    } else {
+        merge_backets_i32(recv_buf, *ret_arr, size, count_arr, ret_count);
+    }
+    free(recv_buf);
+    free(count_arr);
+    report_imbalance(recv_count, rank, size);
+    *ret_offset = calc_global_offset(recv_count, rank);
 }
 
 void samplesort_alg(int *arr, int count, int rank, int size) {
     int self_count = count / size;
-    int *self_arr = (int*) malloc(count * sizeof(int));
+    int *self_arr = (int*) malloc(self_count * sizeof(int));
 
     RET_IF_ERR(
         MPI_Scatter(
@@ -568,25 +1603,28 @@ void samplesort_alg(int *arr, int count, int rank, int size) {
         )
     );
 
-    // quicksort(self_arr, 0, self_count-1);
-    int *help_arr = (int*) malloc(count * sizeof(int));
-    radixsort_bin(self_arr, help_arr, self_count);
-    free(help_arr);
-
-    int *count_arr = (int*) malloc(size * sizeof(int));
-    separate_on_backets(
-        self_arr, count_arr, self_count, count,
+    int sorted_count = 0;
+    int *sorted_arr = NULL;
+    long long offset = 0;
+    samplesort_dist(
+        self_arr, self_count,
+        &sorted_arr, &sorted_count, &offset,
         rank, size
     );
+    free(self_arr);
 
-    merge_into_arr(
-        self_arr, count_arr, self_count, count,
-        rank, size, 
-        arr
+    int *counts_arr = (int*) malloc(size * sizeof(int));
+    RET_IF_ERR(
+        MPI_Allgather(
+            &sorted_count, 1, MPI_INT,
+            counts_arr, 1, MPI_INT,
+            MPI_COMM_WORLD
+        )
     );
+    gather_backets(sorted_arr, counts_arr, count, rank, size, arr);
 
-    free(self_arr);
-    free(count_arr);
+    free(counts_arr);
+    free(sorted_arr);
 }
 
 void samplesort(int *arr, int count, int rank, int size) {
@@ -597,6 +1635,73 @@ void samplesort(int *arr, int count, int rank, int size) {
     samplesort_alg(arr, count, rank, size);
 }
 
+/*
+ * samplesort_dist on the array of the main rank: it is split unevenly,
+ *    the part of the rank q is about proportional to q + 1, and the sorted
+ *    parts are collected back by their offsets.
+ */
+void samplesort_dist_on_main(int *arr, int count, int rank, int size) {
+    check(rank != 0 || arr);
+    check(size > 1);
+
+    int *counts = (int*) malloc(2 * size * sizeof(int));
+    int *displs = counts + size;
+    long long weights = (long long)size * (size + 1) / 2;
+    long long prev = 0;
+    for (int q = 0; q < size; ++q) {
+        long long next = (long long)count * ((q+1) * (q+2) / 2) / weights;
+        counts[q] = next - prev;
+        prev = next;
+    }
+    calc_displs(counts, displs, size);
+
+    int self_count = counts[rank];
+    int *self_arr = (int*) malloc(self_count * sizeof(int));
+    RET_IF_ERR(
+        MPI_Scatterv(
+            arr, counts, displs, MPI_INT,
+            self_arr, self_count, MPI_INT,
+            main_rank, MPI_COMM_WORLD
+        )
+    );
+
+    int sorted_count = 0;
+    int *sorted_arr = NULL;
+    long long offset = 0;
+    samplesort_dist(
+        self_arr, self_count,
+        &sorted_arr, &sorted_count, &offset,
+        rank, size
+    );
+
+    int self_offset = offset;
+    RET_IF_ERR(
+        MPI_Gather(
+            &sorted_count, 1, MPI_INT,
+            counts, 1, MPI_INT,
+            main_rank, MPI_COMM_WORLD
+        )
+    );
+    RET_IF_ERR(
+        MPI_Gather(
+            &self_offset, 1, MPI_INT,
+            displs, 1, MPI_INT,
+            main_rank, MPI_COMM_WORLD
+        )
+    );
+    RET_IF_ERR(
+        MPI_Gatherv(
+            sorted_arr, sorted_count, MPI_INT,
+            arr, counts, displs, MPI_INT,
+            main_rank, MPI_COMM_WORLD
+        )
+    );
+
+    free(self_arr);
+    free(sorted_arr);
+    free(counts);
+}
+
 void get_arr_for_testing_samplesort(int **ret_arr, int *ret_count) {
     /**
      * The sorting of this array must be performed by three processors.
@@ -648,13 +1753,297 @@ void combinedsort(int *arr, int count, int rank, int size) {
     int switch_count = 1500;
     if (count < switch_count) {
         if (rank == main_rank) {
-            quicksort(arr, 0, count - 1);
+            introsort(arr, count);
         }
     } else {
         samplesort_alg(arr, count, rank, size);
     }
 }
 
+// ------------------------------------------------------------- typed keys
+
+/*
+ * Typed interface for int32_t, int64_t, uint64_t, float and double keys and
+ * for (key, index) pairs of them, where index refers to the payload record.
+ * They are sorted by their key bits with the radix and merge kernels of
+ * int, see key_bits_i32 and the others.
+ */
+
+#define DEFINE_KEY_INDEX(T, sfx, key_mpi_type)                              \
+    typedef struct KeyIndex_##sfx##_t {                                     \
+        T key;                                                              \
+        int64_t index;                                                      \
+    } KeyIndex_##sfx;                                                       \
+                                                                            \
+    static MPI_Datatype mpi_type_kv_##sfx(void) {                           \
+        static MPI_Datatype type = MPI_DATATYPE_NULL;                       \
+        if (type == MPI_DATATYPE_NULL) {                                    \
+            int lens[2] = {1, 1};                                           \
+            MPI_Aint displs[2] = {                                          \
+                offsetof(KeyIndex_##sfx, key),                              \
+                offsetof(KeyIndex_##sfx, index),                            \
+            };                                                              \
+            MPI_Datatype types[2] = {key_mpi_type, MPI_INT64_T};            \
+            MPI_Datatype packed;                                            \
+            RET_IF_ERR(                                                     \
+                MPI_Type_create_struct(2, lens, displs, types, &packed)     \
+            );                                                              \
+            RET_IF_ERR(                                                     \
+                MPI_Type_create_resized(                                    \
+                    packed, 0, sizeof(KeyIndex_##sfx), &type                \
+                )                                                           \
+            );                                                              \
+            RET_IF_ERR(MPI_Type_commit(&type));                             \
+            RET_IF_ERR(MPI_Type_free(&packed));                             \
+        }                                                                   \
+        return type;                                                        \
+    }                                                                       \
+                                                                            \
+    static inline uint64_t elem_bits_kv_##sfx(const KeyIndex_##sfx *elem) { \
+        return key_bits_##sfx(elem->key);                                   \
+    }
+
+DEFINE_KEY_INDEX(int32_t,  i32, MPI_INT32_T)
+DEFINE_KEY_INDEX(int64_t,  i64, MPI_INT64_T)
+DEFINE_KEY_INDEX(uint64_t, u64, MPI_UINT64_T)
+DEFINE_KEY_INDEX(float,    f32, MPI_FLOAT)
+DEFINE_KEY_INDEX(double,   f64, MPI_DOUBLE)
+
+typedef int (*CountNotGreaterBits)(const void *arr, int count, uint64_t bits);
+
+/*
+ * calc_splitters_hist on the key bits: the splitter q is the least bits
+ * value with at least (q + 1) / size of all elements not greater than it,
+ * found by bisection in [min, max] of all keys, at most 64 steps.
+ */
+static void calc_splitters_bits(
+    const void *self_arr,
+    int count,
+    uint64_t min_bits,
+    uint64_t max_bits,
+    CountNotGreaterBits count_not_greater_bits,
+    uint64_t *splitters,
+    int size
+) {
+    // min and ~max of all keys in one reduction
+    uint64_t bounds[2] = {min_bits, ~max_bits};
+    RET_IF_ERR(
+        MPI_Allreduce(
+            MPI_IN_PLACE, bounds, 2, MPI_UINT64_T,
+            MPI_MIN, MPI_COMM_WORLD
+        )
+    );
+    long long total = count;
+    RET_IF_ERR(
+        MPI_Allreduce(
+            MPI_IN_PLACE, &total, 1, MPI_LONG_LONG,
+            MPI_SUM, MPI_COMM_WORLD
+        )
+    );
+
+    int splitters_count = size - 1;
+    uint64_t *lo = (uint64_t*) malloc(2*splitters_count * sizeof(uint64_t));
+    uint64_t *hi = lo + splitters_count;
+    long long *counts = (long long*) malloc(
+        splitters_count * sizeof(long long)
+    );
+    for (int q = 0; q < splitters_count; ++q) {
+        lo[q] = bounds[0];
+        hi[q] = ~bounds[1];
+    }
+
+    int active = total > 0;
+    while (active) {
+        for (int q = 0; q < splitters_count; ++q) {
+            counts[q] = count_not_greater_bits(
+                self_arr, count, lo[q] + (hi[q] - lo[q]) / 2
+            );
+        }
+        RET_IF_ERR(
+            MPI_Allreduce(
+                MPI_IN_PLACE, counts, splitters_count, MPI_LONG_LONG,
+                MPI_SUM, MPI_COMM_WORLD
+            )
+        );
+        active = 0;
+        for (int q = 0; q < splitters_count; ++q) {
+            uint64_t mid = lo[q] + (hi[q] - lo[q]) / 2;
+            if (lo[q] == hi[q]) {
+                continue;
+            }
+            if (counts[q] >= total * (q + 1) / size) {
+                hi[q] = mid;
+            } else {
+                lo[q] = mid + 1;
+            }
+            active |= lo[q] != hi[q];
+        }
+    }
+
+    for (int q = 0; q < splitters_count; ++q) {
+        splitters[q] = total > 0 ? hi[q] : UINT64_MAX;
+    }
+    free(lo);
+    free(counts);
+}
+
+/*
+ * Radix and merge kernels of the other element types, the int32_t ones
+ *    are defined with the kernels of int.
+ */
+#define DEFINE_TYPED_KERNELS(Elem, name, Node, key_bits, elem_bits)         \
+    DEFINE_RADIX_LSD(Elem, name, key_bits, elem_bits)                       \
+    DEFINE_MERGE_RUNS(Elem, name, Node, key_bits, elem_bits)
+
+DEFINE_TYPED_KERNELS(int64_t,  i64, LoserNode64, 64, elem_bits_i64)
+DEFINE_TYPED_KERNELS(uint64_t, u64, LoserNode64, 64, elem_bits_u64)
+DEFINE_TYPED_KERNELS(float,    f32, LoserNode32, 32, elem_bits_f32)
+DEFINE_TYPED_KERNELS(double,   f64, LoserNode64, 64, elem_bits_f64)
+
+DEFINE_TYPED_KERNELS(KeyIndex_i32, kv_i32, LoserNode32, 32, elem_bits_kv_i32)
+DEFINE_TYPED_KERNELS(KeyIndex_i64, kv_i64, LoserNode64, 64, elem_bits_kv_i64)
+DEFINE_TYPED_KERNELS(KeyIndex_u64, kv_u64, LoserNode64, 64, elem_bits_kv_u64)
+DEFINE_TYPED_KERNELS(KeyIndex_f32, kv_f32, LoserNode32, 32, elem_bits_kv_f32)
+DEFINE_TYPED_KERNELS(KeyIndex_f64, kv_f64, LoserNode64, 64, elem_bits_kv_f64)
+
+typedef void (*MergeBacketsFunc)(
+    const void *buf,
+    void *help_buf,
+    int backets_count,
+    const int *count_arr,
+    int *new_count
+);
+
+// Size, MPI datatype and kernels of one element type
+typedef struct TypedKernels_t {
+    size_t elem_size;
+    MPI_Datatype type;
+    CountNotGreaterBits count_not_greater;
+    MergeBacketsFunc merge_backets;
+} TypedKernels;
+
+/*
+ * samplesort_dist of any element type after the local sort: self_arr is
+ *    sorted and its key bits are in [min_bits, max_bits]. Splitters are
+ *    always histogram.
+ */
+static void samplesort_dist_sorted(
+    void *self_arr,
+    int self_count,
+    uint64_t min_bits,
+    uint64_t max_bits,
+    const TypedKernels *kernels,
+    void **ret_arr,
+    int *ret_count,
+    long long *ret_offset,
+    int rank,
+    int size
+) {
+    uint64_t *splitters = (uint64_t*) malloc(size * sizeof(uint64_t));
+    calc_splitters_bits(
+        self_arr, self_count, min_bits, max_bits,
+        kernels->count_not_greater, splitters, size
+    );
+    int *count_arr = (int*) malloc(size * sizeof(int));
+    int prev = 0;
+    for (int q = 0; q < size - 1; ++q) {
+        int end = kernels->count_not_greater(
+            self_arr, self_count, splitters[q]
+        );
+        count_arr[q] = end - prev;
+        prev = end;
+    }
+    count_arr[size - 1] = self_count - prev;
+    free(splitters);
+
+    int recv_count = 0;
+    void *recv_buf = NULL;
+    swap_backets(
+        self_arr, &recv_buf, kernels->type, kernels->elem_size,
+        size, count_arr, &recv_count
+    );
+    *ret_arr = malloc(recv_count * kernels->elem_size);
+    kernels->merge_backets(recv_buf, *ret_arr, size, count_arr, ret_count);
+    free(recv_buf);
+    free(count_arr);
+
+    report_imbalance(recv_count, rank, size);
+    *ret_offset = calc_global_offset(recv_count, rank);
+}
+
+/*
+ * Sorts of one element type on top of its kernels: Elem is the element,
+ *    name the suffix of the functions, elem_bits gives the key bits of an
+ *    element and mpi_type its MPI datatype.
+ */
+#define DEFINE_TYPED_SORT(Elem, name, elem_bits, mpi_type)                  \
+    void sort_##name(Elem *arr, int count) {                                \
+        check(count == 0 || arr);                                           \
+        Elem *buf = (Elem*) malloc(count * sizeof(Elem));                   \
+        radixsort_lsd_##name(arr, buf, count, 11);                          \
+        free(buf);                                                          \
+    }                                                                       \
+                                                                            \
+    void samplesort_dist_##name(                                            \
+        Elem *self_arr,                                                     \
+        int self_count,                                                     \
+        Elem **ret_arr,                                                     \
+        int *ret_count,                                                     \
+        long long *ret_offset,                                              \
+        int rank,                                                           \
+        int size                                                            \
+    ) {                                                                     \
+        check(self_count == 0 || self_arr);                                 \
+        check(ret_arr && ret_count && ret_offset);                          \
+        sort_##name(self_arr, self_count);                                  \
+                                                                            \
+        TypedKernels kernels = {                                            \
+            .elem_size = sizeof(Elem),                                      \
+            .type = mpi_type,                                               \
+            .count_not_greater = count_not_greater_##name,                  \
+            .merge_backets = merge_backets_##name,                          \
+        };                                                                  \
+        samplesort_dist_sorted(                                             \
+            self_arr, self_count,                                           \
+            self_count ? elem_bits(&self_arr[0]) : UINT64_MAX,              \
+            self_count ? elem_bits(&self_arr[self_count - 1]) : 0,          \
+            &kernels, (void**)ret_arr, ret_count, ret_offset, rank, size    \
+        );                                                                  \
+    }
+
+DEFINE_TYPED_SORT(int32_t,  i32, elem_bits_i32, MPI_INT32_T)
+DEFINE_TYPED_SORT(int64_t,  i64, elem_bits_i64, MPI_INT64_T)
+DEFINE_TYPED_SORT(uint64_t, u64, elem_bits_u64, MPI_UINT64_T)
+DEFINE_TYPED_SORT(float,    f32, elem_bits_f32, MPI_FLOAT)
+DEFINE_TYPED_SORT(double,   f64, elem_bits_f64, MPI_DOUBLE)
+
+DEFINE_TYPED_SORT(KeyIndex_i32, kv_i32, elem_bits_kv_i32, mpi_type_kv_i32())
+DEFINE_TYPED_SORT(KeyIndex_i64, kv_i64, elem_bits_kv_i64, mpi_type_kv_i64())
+DEFINE_TYPED_SORT(KeyIndex_u64, kv_u64, elem_bits_kv_u64, mpi_type_kv_u64())
+DEFINE_TYPED_SORT(KeyIndex_f32, kv_f32, elem_bits_kv_f32, mpi_type_kv_f32())
+DEFINE_TYPED_SORT(KeyIndex_f64, kv_f64, elem_bits_kv_f64, mpi_type_kv_f64())
+
+#define TYPED_SORT_DISPATCH(arr, fn)                                        \
+    _Generic((arr),                                                         \
+        int32_t*:      fn##_i32,                                            \
+        int64_t*:      fn##_i64,                                            \
+        uint64_t*:     fn##_u64,                                            \
+        float*:        fn##_f32,                                            \
+        double*:       fn##_f64,                                            \
+        KeyIndex_i32*: fn##_kv_i32,                                         \
+        KeyIndex_i64*: fn##_kv_i64,                                         \
+        KeyIndex_u64*: fn##_kv_u64,                                         \
+        KeyIndex_f32*: fn##_kv_f32,                                         \
+        KeyIndex_f64*: fn##_kv_f64                                          \
+    )
+
+// Local sort of count keys or (key, index) pairs of any supported type
+#define sort_keys(arr, count) TYPED_SORT_DISPATCH(arr, sort)(arr, count)
+
+// samplesort_dist of keys or (key, index) pairs of any supported type
+#define samplesort_dist_keys(self_arr, ...)                                 \
+    TYPED_SORT_DISPATCH(self_arr, samplesort_dist)(self_arr, __VA_ARGS__)
+
 // ------------------------------------------------------------------------
 
 typedef enum SortType_t {
@@ -664,11 +2053,17 @@ typedef enum SortType_t {
     SORTYPE_BINRADIX,
     SORTYPE_SAMPLE,
     SORTYPE_COMB,
+    SORTYPE_SAMPLE_DIST,
+    SORTYPE_LSD_RADIX,
+    SORTYPE_INTRO,
 } SortType;
 
 typedef enum Mode_t {
     MODE_EXEC = 1,
     MODE_CHECK,
+    MODE_TYPED,
+    MODE_BENCH_RADIX,
+    MODE_EMPTY_BUCKETS,
 } Mode;
 
 const char *sort_type_to_str(SortType sort_type) {
@@ -679,13 +2074,29 @@ const char *sort_type_to_str(SortType sort_type) {
         case SORTYPE_BINRADIX: return "bin_radixsort";
         case SORTYPE_SAMPLE:   return "samplesort";
         case SORTYPE_COMB:     return "combinedsort";
+        case SORTYPE_SAMPLE_DIST: return "dist_samplesort";
+        case SORTYPE_LSD_RADIX: return "lsd_radixsort";
+        case SORTYPE_INTRO:    return "introsort";
         default: check_ames(0, "Incorect mode");
     }
     return "Unreachable";
 }
 
+const char *input_pattern_to_str(InputPattern pattern) {
+    switch (pattern) {
+        case INPUT_RANDOM:     return "random";
+        case INPUT_SORTED:     return "sorted";
+        case INPUT_REVERSE:    return "reverse";
+        case INPUT_FEW_UNIQUE: return "few-unique";
+        case INPUT_ORGAN_PIPE: return "organ-pipe";
+        default: check_ames(0, "Unknown input pattern");
+    }
+    return "Unreachable";
+}
+
 int use_proc(SortType sort_type) {
-    return sort_type == SORTYPE_SAMPLE || sort_type == SORTYPE_COMB;
+    return sort_type == SORTYPE_SAMPLE || sort_type == SORTYPE_COMB
+                                    || sort_type == SORTYPE_SAMPLE_DIST;
 }
 
 void sort_with_mode(
@@ -715,6 +2126,15 @@ void sort_with_mode(
         case SORTYPE_COMB:
             combinedsort(arr, count, rank, size);
             break;
+        case SORTYPE_SAMPLE_DIST:
+            samplesort_dist_on_main(arr, count, rank, size);
+            break;
+        case SORTYPE_LSD_RADIX:
+            if (rank == main_rank) { radixsort_lsd_i32(arr, buf, count, 11); }
+            break;
+        case SORTYPE_INTRO:
+            if (rank == main_rank) { introsort(arr, count); }
+            break;
         default: check_ames(0, "Incorect mode");
     }
 }
@@ -732,7 +2152,7 @@ void test_exec_time(
         int *arr = NULL;
         int *buf = NULL;
         if (rank == main_rank) {
-            arr = generate_random_array(count, INT_MAX, 7);
+            arr = generate_array(count, input_pattern, 7);
             buf = (int*) malloc(count * sizeof(int));
         }
         RET_IF_ERR(MPI_Barrier(MPI_COMM_WORLD));
@@ -742,12 +2162,18 @@ void test_exec_time(
             start = clock();
         }
 
+        bucket_imbalance = 0;
         sort_with_mode(arr, count, buf, sort_type, rank, size);
 
         if (rank == 0) {
             end = clock();
             double delta_time = (double)(end - start) / CLOCKS_PER_SEC;
-            printf("time: %f on %d elements\n", delta_time, count);
+            if (bucket_imbalance > 0) {
+                printf("time: %f on %d elements, buckets max/mean %f\n",
+                                        delta_time, count, bucket_imbalance);
+            } else {
+                printf("time: %f on %d elements\n", delta_time, count);
+            }
             free(arr);
             free(buf);
         }
@@ -766,28 +2192,264 @@ void test_correctness(
     int *buf = NULL;
     if (rank == main_rank) {
         printf(
-            "Sorting random array of len %d with %s%d\n",
+            "Sorting %s array of len %d with %s%d\n",
+            input_pattern_to_str(input_pattern),
             count,
             sort_type_to_str(sort_type),
             use_proc(sort_type) ? size : 1
         );
-        arr = generate_random_array(count, INT_MAX, 7);
+        arr = generate_array(count, input_pattern, 7);
         buf = (int*) malloc(count * sizeof(int));
         start = clock();
     }
 
+    bucket_imbalance = 0;
     sort_with_mode(arr, count, buf, sort_type, rank, size);
 
     if (rank == main_rank) {
         end = clock();
         double delta_time = (double)(end - start) / CLOCKS_PER_SEC;
         printf("time: %f\n", delta_time);
+        if (bucket_imbalance > 0) {
+            printf("buckets max/mean: %f\n", bucket_imbalance);
+        }
         printf("correct: %s\n", check_arr(arr, count) ? "true" : "false");
         free(arr);
         free(buf);
     }
 }
 
+// Keys of the typed test: about two elements per key, some special floats
+static inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+static inline int32_t gen_key_i32(uint64_t h) { return (int32_t)h; }
+static inline int64_t gen_key_i64(uint64_t h) { return (int64_t)h; }
+static inline uint64_t gen_key_u64(uint64_t h) { return h; }
+
+static inline double gen_key_f64(uint64_t h) {
+    switch (h % 97) {
+        case 0: return -0.0;
+        case 1: return 1.0 / 0.0;
+        case 2: return -1.0 / 0.0;
+    }
+    return (double)((int64_t)h >> 20) / 1024;
+}
+
+static inline float gen_key_f32(uint64_t h) { return gen_key_f64(h); }
+
+// Non-empty parts of all ranks have to follow each other in order
+static int check_parts_order(
+    uint64_t first_bits,
+    uint64_t last_bits,
+    int count,
+    int size
+) {
+    uint64_t self[3] = {count > 0, first_bits, last_bits};
+    uint64_t *all = (uint64_t*) malloc(3 * size * sizeof(uint64_t));
+    RET_IF_ERR(
+        MPI_Allgather(
+            self, 3, MPI_UINT64_T,
+            all, 3, MPI_UINT64_T,
+            MPI_COMM_WORLD
+        )
+    );
+    int correct = 1;
+    uint64_t prev_last = 0;
+    for (int q = 0; q < size; ++q) {
+        if (all[3*q] && all[3*q + 1] < prev_last) {
+            correct = 0;
+        }
+        if (all[3*q]) {
+            prev_last = all[3*q + 2];
+        }
+    }
+    free(all);
+    return correct;
+}
+
+/*
+ * Sorts keys and (key, index) pairs of the type by samplesort_dist_keys,
+ *    the pair with the index i has to keep the key generated for i.
+ */
+#define DEFINE_TYPED_TEST(T, sfx)                                           \
+    static int test_typed_##sfx(int count_per_proc, int rank, int size) {   \
+        long long total = (long long)count_per_proc * size;                 \
+        uint64_t keys_count = total/2 + 1;                                  \
+        T *keys = (T*) malloc(count_per_proc * sizeof(T));                  \
+        KeyIndex_##sfx *pairs = (KeyIndex_##sfx*) malloc(                   \
+            count_per_proc * sizeof(KeyIndex_##sfx)                         \
+        );                                                                  \
+        for (int q = 0; q < count_per_proc; ++q) {                          \
+            int64_t index = (int64_t)rank * count_per_proc + q;             \
+            keys[q] = gen_key_##sfx(splitmix64(index % keys_count));        \
+            pairs[q].key = keys[q];                                         \
+            pairs[q].index = index;                                         \
+        }                                                                   \
+                                                                            \
+        int correct = 1;                                                    \
+        T *sorted_keys = NULL;                                              \
+        KeyIndex_##sfx *sorted_pairs = NULL;                                \
+        int counts[2] = {0, 0};                                             \
+        long long offsets[2] = {0, 0};                                      \
+        samplesort_dist_keys(                                               \
+            keys, count_per_proc,                                           \
+            &sorted_keys, &counts[0], &offsets[0], rank, size               \
+        );                                                                  \
+        samplesort_dist_keys(                                               \
+            pairs, count_per_proc,                                          \
+            &sorted_pairs, &counts[1], &offsets[1], rank, size              \
+        );                                                                  \
+        for (int q = 1; q < counts[0]; ++q) {                               \
+            if (key_bits_##sfx(sorted_keys[q])                              \
+                        < key_bits_##sfx(sorted_keys[q - 1])) {             \
+                correct = 0;                                                \
+            }                                                               \
+        }                                                                   \
+        for (int q = 0; q < counts[1]; ++q) {                               \
+            T key = gen_key_##sfx(                                          \
+                splitmix64(sorted_pairs[q].index % keys_count)              \
+            );                                                              \
+            if (key_bits_##sfx(key) != key_bits_##sfx(sorted_pairs[q].key)  \
+                || (q > 0 && key_bits_##sfx(sorted_pairs[q].key)            \
+                        < key_bits_##sfx(sorted_pairs[q - 1].key))) {       \
+                correct = 0;                                                \
+            }                                                               \
+        }                                                                   \
+        correct &= check_parts_order(                                       \
+            counts[0] ? key_bits_##sfx(sorted_keys[0]) : 0,                 \
+            counts[0] ? key_bits_##sfx(sorted_keys[counts[0] - 1]) : 0,     \
+            counts[0], size                                                 \
+        );                                                                  \
+        correct &= check_parts_order(                                       \
+            counts[1] ? key_bits_##sfx(sorted_pairs[0].key) : 0,            \
+            counts[1] ? key_bits_##sfx(sorted_pairs[counts[1]-1].key) : 0,  \
+            counts[1], size                                                 \
+        );                                                                  \
+        long long sums[2] = {counts[0], counts[1]};                         \
+        RET_IF_ERR(                                                         \
+            MPI_Allreduce(                                                  \
+                MPI_IN_PLACE, sums, 2, MPI_LONG_LONG,                       \
+                MPI_SUM, MPI_COMM_WORLD                                     \
+            )                                                               \
+        );                                                                  \
+        correct &= sums[0] == total && sums[1] == total;                    \
+        correct &= offsets[0] == offsets[1] && counts[0] == counts[1];      \
+        RET_IF_ERR(                                                         \
+            MPI_Allreduce(                                                  \
+                MPI_IN_PLACE, &correct, 1, MPI_INT,                         \
+                MPI_MIN, MPI_COMM_WORLD                                     \
+            )                                                               \
+        );                                                                  \
+                                                                            \
+        free(keys);                                                         \
+        free(pairs);                                                        \
+        free(sorted_keys);                                                  \
+        free(sorted_pairs);                                                 \
+        return correct;                                                     \
+    }
+
+DEFINE_TYPED_TEST(int32_t,  i32)
+DEFINE_TYPED_TEST(int64_t,  i64)
+DEFINE_TYPED_TEST(uint64_t, u64)
+DEFINE_TYPED_TEST(float,    f32)
+DEFINE_TYPED_TEST(double,   f64)
+
+/*
+ * Regression of ranks that get only empty parts to merge: two distinct
+ *    values fill at most two buckets, with both ways to find splitters.
+ */
+void test_empty_buckets(int count_per_proc, int rank, int size) {
+    const SortType sort_types[] = {
+        SORTYPE_SAMPLE, SORTYPE_COMB, SORTYPE_SAMPLE_DIST,
+    };
+    const SplittersType splitters_types[] = {
+        SPLITTERS_HIST, SPLITTERS_GATHER,
+    };
+    int count = count_per_proc * size;
+    for (int q = 0; q < 3; ++q) {
+        for (int w = 0; w < 2; ++w) {
+            splitters_type = splitters_types[w];
+            int *arr = NULL;
+            if (rank == main_rank) {
+                arr = generate_random_array(count, 2, 7);
+            }
+            sort_with_mode(arr, count, NULL, sort_types[q], rank, size);
+            if (rank == main_rank) {
+                printf(
+                    "%s%d, splitters %d, two values: correct: %s\n",
+                    sort_type_to_str(sort_types[q]), size, splitters_type,
+                    check_arr(arr, count) ? "true" : "false"
+                );
+                free(arr);
+            }
+        }
+    }
+}
+
+void test_typed(int count_per_proc, int rank, int size) {
+    const char *names[] = {"int32", "int64", "uint64", "float", "double"};
+    int results[] = {
+        test_typed_i32(count_per_proc, rank, size),
+        test_typed_i64(count_per_proc, rank, size),
+        test_typed_u64(count_per_proc, rank, size),
+        test_typed_f32(count_per_proc, rank, size),
+        test_typed_f64(count_per_proc, rank, size),
+    };
+    if (rank == main_rank) {
+        for (int q = 0; q < 5; ++q) {
+            printf(
+                "%s keys and pairs: correct: %s\n",
+                names[q], results[q] ? "true" : "false"
+            );
+        }
+    }
+}
+
+/*
+ * Local radix sorts on the same random arrays, one line per sort:
+ *    elements, name, seconds, ns per element. The base 10 radixsort is
+ *    skipped above 1e8 elements, it takes too long.
+ */
+void bench_radix(int max_count) {
+    const char *names[] = {
+        "radixsort", "bin_radixsort", "lsd_radixsort8", "lsd_radixsort11",
+    };
+    printf("elements,sort,seconds,ns_per_element\n");
+    for (long long count = 1000000; count <= max_count; count *= 10) {
+        int *src = generate_random_array(count, INT_MAX, 7);
+        int *arr = (int*) malloc(count * sizeof(int));
+        int *buf = (int*) malloc(count * sizeof(int));
+        for (int q = 0; q < 4; ++q) {
+            if (q == 0 && count > 100000000) {
+                continue;
+            }
+            memcpy(arr, src, count * sizeof(int));
+            double start = MPI_Wtime();
+            switch (q) {
+                case 0: radixsort(arr, buf, count); break;
+                case 1: radixsort_bin(arr, buf, count); break;
+                case 2: radixsort_lsd_i32(arr, buf, count, 8); break;
+                case 3: radixsort_lsd_i32(arr, buf, count, 11); break;
+            }
+            double delta_time = MPI_Wtime() - start;
+            check_ames(check_arr(arr, count), "Radix sort failed");
+            printf(
+                "%lld,%s,%f,%.2f\n",
+                count, names[q], delta_time, delta_time * 1e9 / count
+            );
+            fflush(stdout);
+        }
+        free(src);
+        free(arr);
+        free(buf);
+    }
+}
+
 void parse_params(
     int argc,
     char **argv,
@@ -804,9 +2466,10 @@ void parse_params(
         "You should specify more than 1 proc for this program!"
     );
     check_ames(
-        argc == 4,
+        4 <= argc && argc <= 8,
         "You should specify 3 arguments: mode, sort type "
-                                                    "and count_per_proc"
+                "and count_per_proc, then optional oversample, splitters, "
+                "threads and input pattern"
     );
 
     *ret_mode = atoi(argv[1]);
@@ -816,12 +2479,43 @@ void parse_params(
     check_ames(0 < *ret_sort_type, "Sort type must be positive integer");
     check_ames(0 < *ret_count_per_proc,
                                 "count_per_proc must be positive int");
+    if (argc > 4) {
+        oversample = atoi(argv[4]);
+        check_ames(0 < oversample, "oversample must be positive int");
+    }
+    if (argc > 5) {
+        splitters_type = atoi(argv[5]);
+        check_ames(
+            splitters_type == SPLITTERS_HIST
+                || splitters_type == SPLITTERS_GATHER,
+            "Unknown splitters type"
+        );
+    }
+    if (argc > 6) {
+        threads_count = atoi(argv[6]);
+        check_ames(0 < threads_count, "threads must be positive int");
+    }
+    if (argc > 7) {
+        input_pattern = atoi(argv[7]);
+        check_ames(
+            INPUT_RANDOM <= input_pattern && input_pattern <= INPUT_ORGAN_PIPE,
+            "Unknown input pattern"
+        );
+    }
 }
 
 // ------------------------------------------------------------------- main
 
 int main(int argc, char **argv) {
-    RET_IF_ERR(MPI_Init(&argc, &argv));
+    // Only the main thread of a rank calls MPI
+    int provided = 0;
+    RET_IF_ERR(
+        MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided)
+    );
+    check_ames(
+        provided >= MPI_THREAD_FUNNELED,
+        "MPI does not support threads"
+    );
 
     int rank, size;
     RET_IF_ERR(MPI_Comm_rank(MPI_COMM_WORLD, &rank));
@@ -839,6 +2533,17 @@ int main(int argc, char **argv) {
         case MODE_CHECK:
             test_correctness(sort_type, count_per_proc, rank, size);
             break;
+        case MODE_TYPED:
+            test_typed(count_per_proc, rank, size);
+            break;
+        case MODE_BENCH_RADIX:
+            if (rank == main_rank) {
+                bench_radix(count_per_proc);
+            }
+            break;
+        case MODE_EMPTY_BUCKETS:
+            test_empty_buckets(count_per_proc, rank, size);
+            break;
         default:
             check_ames(0, "Unknown mode");
     }